@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <malloc.h>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "cpplogo/soo.h"
+#include "cpplogo/logo.h"
+#include "cpplogo/trace.h"
+
+using std::vector;
+using namespace cpplogo;
+
+//Track every allocation made through operator new, so each benchmark can
+//report how many allocations it made and how much memory it held at its peak
+static std::atomic<size_t> g_num_allocs(0);
+static std::atomic<size_t> g_bytes_allocated(0);
+static std::atomic<size_t> g_live_bytes(0);
+static std::atomic<size_t> g_peak_live_bytes(0);
+
+void* operator new(size_t size)
+{
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  size_t usable = malloc_usable_size(ptr);
+  g_num_allocs++;
+  g_bytes_allocated += usable;
+  size_t live = (g_live_bytes += usable);
+  size_t peak = g_peak_live_bytes.load();
+  while (live > peak && !g_peak_live_bytes.compare_exchange_weak(peak, live)) {}
+  return ptr;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* ptr) noexcept
+{
+  if (!ptr) return;
+  g_live_bytes -= malloc_usable_size(ptr);
+  std::free(ptr);
+}
+#pragma GCC diagnostic pop
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  operator delete(ptr);
+}
+
+//Times one benchmark and prints its results as a single line of JSON
+class Measurement {
+  public:
+    Measurement(const char* benchmark, const char* algorithm, int dim,
+                size_t num_nodes) :
+      benchmark_(benchmark), algorithm_(algorithm), dim_(dim),
+      num_nodes_(num_nodes), start_allocs_(g_num_allocs.load()),
+      start_bytes_(g_bytes_allocated.load()), start_()
+    {
+      g_peak_live_bytes = g_live_bytes.load();
+      start_ = clock::now();
+    }
+
+    void Stop(size_t num_ops)
+    {
+      std::chrono::duration<double, std::nano> elapsed = clock::now() - start_;
+      size_t allocs = g_num_allocs.load() - start_allocs_;
+      size_t bytes = g_bytes_allocated.load() - start_bytes_;
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      double ops = num_ops ? num_ops : 1;
+      double nodes = num_nodes_ ? num_nodes_ : 1;
+      std::printf("{\"benchmark\": \"%s\", \"algorithm\": \"%s\", "
+                  "\"dim\": %d, \"nodes\": %zu, \"ops\": %zu, "
+                  "\"ns_per_op\": %.1f, \"allocs_per_op\": %.3f, "
+                  "\"bytes_per_op\": %.1f, \"peak_bytes\": %zu, "
+                  "\"peak_bytes_per_node\": %.1f, \"max_rss_kb\": %ld}\n",
+                  benchmark_, algorithm_, dim_, num_nodes_, num_ops,
+                  elapsed.count() / ops, allocs / ops, bytes / ops,
+                  g_peak_live_bytes.load(), g_peak_live_bytes.load() / nodes,
+                  usage.ru_maxrss);
+      std::fflush(stdout);
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+    const char* benchmark_;
+    const char* algorithm_;
+    int dim_;
+    size_t num_nodes_;
+    size_t start_allocs_;
+    size_t start_bytes_;
+    clock::time_point start_;
+};
+
+//Optimizers that expose their internals to the benchmarks
+class BenchSOO : public SOO {
+  public:
+    BenchSOO(const SOO::Options& opt) : SOO(opt) {}
+
+    using SOO::BestNodeAtDepth;
+    using SOO::RemoveNode;
+    using SOO::ExpandNode;
+
+    size_t num_levels() const { return space_.size(); }
+    size_t num_nodes() const
+    {
+      size_t num_nodes = 0;
+      for (const auto& level : space_) num_nodes += level.size();
+      return num_nodes;
+    }
+
+    //Expand a node without keeping any of its children
+    void ExpandAndDiscard(const Node* node, vector<Node>* children)
+    {
+      children->clear();
+      ExpandNode(node, children);
+      for (const Node& child : *children) arena_.Retire(child.handle());
+      arena_.Recycle();
+    }
+};
+
+class BenchLOGO : public LOGO {
+  public:
+    BenchLOGO(const LOGO::Options& opt) : LOGO(opt) {}
+
+    using LOGO::EndStep;
+
+    size_t num_nodes() const
+    {
+      size_t num_nodes = 0;
+      for (const auto& level : space_) num_nodes += level.size();
+      return num_nodes;
+    }
+};
+
+//Trivial objective, so that the benchmarks are dominated by bookkeeping
+void sphere_batch(const matrixd& points, vectord* values)
+{
+  const size_t dim = points.size2();
+  const double* data = &points.data()[0];
+  for (size_t r = 0; r < points.size1(); r++) {
+    const double* p = data + r*dim;
+    double sum = 0.0;
+    for (size_t i = 0; i < dim; i++) {
+      double x = p[i] - 0.3;
+      sum += x * x;
+    }
+    (*values)(r) = -sum;
+  }
+}
+
+double sphere(const vectord& x)
+{
+  matrixd point(1, x.size());
+  for (size_t i = 0; i < x.size(); i++) point(0, i) = x(i);
+  vectord value(1);
+  sphere_batch(point, &value);
+  return value(0);
+}
+
+constexpr int c_num_children = 3;
+constexpr size_t c_num_ops = 100000;
+
+//Keeps the compiler from optimizing away the operations being measured
+static volatile double g_sink = 0.0;
+
+template <typename Options>
+void set_common_options(Options* opt)
+{
+  opt->batch_fn = sphere_batch;
+  opt->evaluator = std::make_shared<SerialEvaluator>();
+}
+
+//Grow a tree with whole Step() calls until it holds at least 'num_nodes'
+//nodes
+template <typename Alg>
+void grow(Alg* alg, const char* algorithm, int dim, size_t num_nodes)
+{
+  Measurement m("Step", algorithm, dim, num_nodes);
+  size_t num_steps = 0;
+  while (alg->num_nodes() < num_nodes) {
+    alg->Step();
+    num_steps++;
+  }
+  m.Stop(num_steps);
+}
+
+void bench_soo(int dim, size_t num_nodes)
+{
+  SOO::Options opt(sphere, dim, std::numeric_limits<int>::max(),
+                   c_num_children);
+  set_common_options(&opt);
+  BenchSOO soo(opt);
+  grow(&soo, "SOO", dim, num_nodes);
+
+  const size_t num_levels = soo.num_levels();
+  {
+    Measurement m("BestNodeAtDepth", "SOO", dim, num_nodes);
+    double sum = 0.0;
+    for (size_t i = 0; i < c_num_ops; i++) {
+      const Node* node = soo.BestNodeAtDepth(i % num_levels);
+      if (node) sum += node->value();
+    }
+    m.Stop(c_num_ops);
+    g_sink = g_sink + sum;
+  }
+  {
+    Measurement m("BestNode", "SOO", dim, num_nodes);
+    double sum = 0.0;
+    for (size_t i = 0; i < c_num_ops; i++) {
+      sum += soo.BestNode()->value();
+    }
+    m.Stop(c_num_ops);
+    g_sink = g_sink + sum;
+  }
+  {
+    // Expansions cost O(dim), so do fewer of them in higher dimensions
+    const size_t num_expansions = std::min(c_num_ops, 10 * c_num_ops / dim);
+    vector<Node> children;
+    children.reserve(c_num_children);
+    Measurement m("ExpandNode", "SOO", dim, num_nodes);
+    size_t num_ops = 0;
+    for (size_t i = 0; i < num_expansions; i++) {
+      const Node* node = soo.BestNodeAtDepth(i % num_levels);
+      if (!node) continue;
+      soo.ExpandAndDiscard(node, &children);
+      num_ops++;
+    }
+    m.Stop(num_ops);
+  }
+  {
+    // Removal is destructive, so it goes last
+    const size_t num_removals = std::min(c_num_ops, num_nodes / 2);
+    Measurement m("RemoveNode", "SOO", dim, num_nodes);
+    size_t num_ops = 0;
+    for (size_t i = 0; num_ops < num_removals; i++) {
+      Node* node = soo.BestNodeAtDepth(i % num_levels);
+      if (!node) continue;
+      soo.RemoveNode(node);
+      num_ops++;
+    }
+    m.Stop(num_ops);
+  }
+}
+
+void bench_logo(int dim, size_t num_nodes)
+{
+  LOGO::Options opt(sphere, dim, std::numeric_limits<int>::max(),
+                    c_num_children, {3, 4, 5, 6, 8, 30});
+  set_common_options(&opt);
+  BenchLOGO logo(opt);
+  grow(&logo, "LOGO", dim, num_nodes);
+
+  Measurement m("EndStep", "LOGO", dim, num_nodes);
+  for (size_t i = 0; i < c_num_ops; i++) {
+    logo.EndStep();
+  }
+  m.Stop(c_num_ops);
+}
+
+//Record as many observations into a trace as fit in its ring, i.e. the
+//cost seen by the optimizer while the background writer keeps up. Like the
+//optimizers, read the clock once per batch of children.
+void bench_trace(int dim)
+{
+  char path[] = "/tmp/bench_cpplogo_trace_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return;
+  close(fd);
+
+  {
+    TraceWriter trace(path, dim);
+    const size_t num_records = std::min(c_num_ops, trace.ring_slots());
+    Measurement m("TraceRecord", "TraceWriter", dim, 0);
+    uint64_t now = 0;
+    for (size_t i = 0; i < num_records; i++) {
+      if (i % (c_num_children-1) == 0) now = trace.Now();
+      trace.Record(now, i / 100, i % 50, -static_cast<double>(i),
+                   [i](size_t d) { return (i + d) * 1e-6; });
+    }
+    m.Stop(num_records);
+  }
+  unlink(path);
+}
+
+//Usage: bench_cpplogo [max_nodes] [max_cells]
+//Runs every benchmark for each combination of dimension and tree size with
+//at most 'max_nodes' nodes and 'max_cells' = dimension * nodes, and prints
+//one JSON object per line.
+int main(int argc, char** argv)
+{
+  size_t max_nodes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  size_t max_cells = argc > 2 ? std::strtoull(argv[2], nullptr, 10)
+                              : 10000000;
+
+  const vector<int> dims = {2, 10, 100, 1000};
+  const vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+  for (int dim : dims) {
+    bench_trace(dim);
+    for (size_t num_nodes : sizes) {
+      if (num_nodes > max_nodes || dim * num_nodes > max_cells) continue;
+      bench_soo(dim, num_nodes);
+      bench_logo(dim, num_nodes);
+    }
+  }
+  return 0;
+}
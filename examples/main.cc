@@ -1,3 +1,4 @@
+#include <chrono>
 #include <iostream>
 
 #include "cpplogo/logging.h"
@@ -6,14 +7,18 @@
 #include "cpplogo/randomsoo.h"
 #include "cpplogo/logo.h"
 #include "cpplogo/randomlogo.h"
+#include "cpplogo/portfolio.h"
 
 using std::vector;
 using namespace cpplogo;
 
 struct Function {
   cpplogo::ObjectiveFn fn;
+  cpplogo::BatchObjectiveFn batch_fn;
   double max;
   int dim;
+  double lower;  //Bounds of every dimension of the domain
+  double upper;
 };
 
 //Calculate the error of an function observation
@@ -36,6 +41,8 @@ template <typename Alg, typename... OptArgs>
 void evaluate(const Function& fn, double epsilon, OptArgs... args) 
 {
   typename Alg::Options opt(fn.fn, fn.dim, c_max_obs, c_num_children, args...);
+  opt.batch_fn = fn.batch_fn;
+  opt.bounds.assign(fn.dim, Bound(fn.lower, fn.upper));
   Alg alg(opt);
 
   double best = alg.BestNode()->value();
@@ -45,24 +52,39 @@ void evaluate(const Function& fn, double epsilon, OptArgs... args)
   }
   LOG(output) << "Number of function evaluations: " << alg.num_observations();
   LOG(output) << "Error: " << obs_error(alg.BestNode()->value(), fn);
-  LOG(output) << "Best: " << alg.BestNode()->Center();
+  LOG(output) << "Best: " << alg.BestPoint();
+  if (Stats::enabled) {
+    LOG(output) << "Time in objective: " << alg.stats().total_fn_seconds()
+                << "s of " << alg.stats().total_seconds() << "s";
+  }
 }
 
 template <typename Alg, typename... OptArgs>
 void evaluate_many(const Function& fn, double epsilon, int count, OptArgs... args) 
 {
-  vector<int> obs;
+  //Run every seed at once, each until it reaches error epsilon on its own
+  Portfolio::Options portfolio_opt;
+  portfolio_opt.target_value = fn.max - (fn.max == 0.0 ? epsilon
+                                                       : epsilon * fabs(fn.max));
+  portfolio_opt.share_target = false;
+  Portfolio portfolio(portfolio_opt);
+
+  //Different seeds often observe the same points, so share the values
+  auto cache = std::make_shared<EvaluationCache>(fn.dim, 1 << 16);
   for (int seed = 0; seed < count; seed++) {
     typename Alg::Options opt(fn.fn, fn.dim, c_max_obs, c_num_children, 
                               seed, args...);
-    Alg alg(opt);
+    opt.batch_fn = fn.batch_fn;
+    opt.bounds.assign(fn.dim, Bound(fn.lower, fn.upper));
+    opt.evaluator = std::make_shared<SerialEvaluator>();
+    opt.cache = cache;
+    portfolio.Add(std::make_shared<Alg>(opt));
+  }
+  const Portfolio::Result& result = portfolio.Run();
 
-    double best = alg.BestNode()->value();
-    while (obs_error(best, fn) > epsilon && !alg.IsFinished()) {
-      alg.Step();  
-      best = alg.BestNode()->value();
-    }
-    obs.push_back(alg.num_observations());
+  vector<int> obs;
+  for (size_t m = 0; m < portfolio.num_members(); m++) {
+    obs.push_back(portfolio.member(m)->num_observations());
   }
   LOG(output) << "# evaluations over " << count << " runs: ";
   LOG(output) << "  Min: " << *std::min_element(obs.begin(), obs.end());
@@ -70,33 +92,83 @@ void evaluate_many(const Function& fn, double epsilon, int count, OptArgs... arg
   double avg = std::accumulate(obs.begin(), obs.end(), 0) 
                / static_cast<double>(obs.size());
   LOG(output) << "  Avg: " << avg;
+  LOG(output) << "Cache hits: " << cache->num_hits() 
+              << ", misses: " << cache->num_misses();
+  LOG(debug) << "Portfolio: " << result.num_steps << " steps ("
+             << result.num_steals << " stolen) in " << result.seconds << "s";
 }
 
 //Objective functions
-double rosenbrock(const vectord& input) {
-  double min = -5.0; double max = 10.0;
-  vectord it(input);
-  for (auto& x : it) x = min + x * (max - min);
+double rosenbrock(const vectord& x) {
   double sum = 0.0;
-  for (size_t i = 0; i < it.size()-1; i++) {
-    sum += 100.0 * pow(it(i+1) - it(i) * it(i), 2.0) 
-           + pow(1.0 - it(i), 2.0);
+  for (size_t i = 0; i < x.size()-1; i++) {
+    sum += 100.0 * pow(x(i+1) - x(i) * x(i), 2.0) 
+           + pow(1.0 - x(i), 2.0);
   }
   return -sum;
 }
 
+//Batch version of rosenbrock: works straight out of the matrix rows, with no
+//per-point copies or calls through std::function
+void rosenbrock_batch(const matrixd& points, vectord* values) {
+  const size_t dim = points.size2();
+  const double* data = &points.data()[0];
+  for (size_t r = 0; r < points.size1(); r++) {
+    const double* p = data + r*dim;
+    double sum = 0.0;
+    for (size_t i = 0; i < dim-1; i++) {
+      double a = p[i+1] - p[i] * p[i];
+      double b = 1.0 - p[i];
+      sum += 100.0 * (a * a) + b * b;
+    }
+    (*values)(r) = -sum;
+  }
+}
+
 Function rosenbrock2_fn {
   .fn = rosenbrock,
+  .batch_fn = rosenbrock_batch,
   .max = 0.0,
   .dim = 2,
+  .lower = -5.0,
+  .upper = 10.0,
 };
 
 Function rosenbrock10_fn {
   .fn = rosenbrock,
+  .batch_fn = rosenbrock_batch,
   .max = 0.0,
   .dim = 10,
+  .lower = -5.0,
+  .upper = 10.0,
 };
 
+//Compare how fast the single-point and batch versions of an objective can get
+//through the same set of points
+void compare_throughput(const Function& fn, int num_points) {
+  RandomEngine rng(0);
+  std::uniform_real_distribution<double> dist(fn.lower, fn.upper);
+  matrixd points(num_points, fn.dim);
+  for (auto& x : points.data()) x = dist(rng);
+  vectord values(num_points);
+
+  using clock = std::chrono::steady_clock;
+  auto start = clock::now();
+  vectord point(fn.dim);
+  for (int r = 0; r < num_points; r++) {
+    for (int d = 0; d < fn.dim; d++) point(d) = points(r, d);
+    values(r) = fn.fn(point);
+  }
+  std::chrono::duration<double> single = clock::now() - start;
+
+  start = clock::now();
+  fn.batch_fn(points, &values);
+  std::chrono::duration<double> batch = clock::now() - start;
+
+  LOG(output) << "Single: " << num_points / single.count() << " points/s";
+  LOG(output) << "Batch:  " << num_points / batch.count() << " points/s";
+}
+
 void test_all_on_fn(const Function& fn) {
   vector<int> logo_w = {3, 4, 5, 6, 8, 30};
 
@@ -120,6 +192,8 @@ int main() {
   test_all_on_fn(rosenbrock2_fn);
   LOG(output) << "=== rosenbrock_10 ===";
   test_all_on_fn(rosenbrock10_fn);
+  LOG(output) << "=== rosenbrock_10 throughput ===";
+  compare_throughput(rosenbrock10_fn, 1000000);
 
   return 0;
 }
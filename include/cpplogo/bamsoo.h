@@ -0,0 +1,95 @@
+/***********************************************************
+* bamsoo.h
+* Implements BaMSOO, which uses a Gaussian process to skip
+* the evaluation of nodes that are unlikely to be better
+* than the best observation so far.
+***********************************************************/
+#pragma once
+#include "cpplogo/soo.h"
+#include "cpplogo/gp.h"
+
+namespace cpplogo {
+
+/***********************************************************
+* ObserveUCB
+* Observation policy: only evaluate the objective at nodes
+* whose upper confidence bound under the Gaussian process is
+* at least the best value observed so far. Every other node
+* gets its lower confidence bound as a fake value, but no
+* more than 'max_fakes_per_observation' nodes per real
+* observation, so a GP that is wrong about the objective
+* can't keep the search expanding fake nodes forever.
+* The GP is conditioned on every real observation as it is
+* made. Once it holds 'gp_max_points' of them, it forgets
+* all but the best one and the most recent half, which
+* bounds both its memory and the O(n^2) cost of screening a
+* node.
+***********************************************************/
+class ObserveUCB {
+  public:
+    struct Options {
+      using Args = std::tuple<>;
+      Options() :
+        ucb_eta(0.05), gp_length_scale(0.1), gp_signal_variance(1.0),
+        gp_noise_variance(1e-6), gp_max_points(1000),
+        max_fakes_per_observation(8)
+      {}
+      double ucb_eta;            // Confidence parameter of the bounds, in
+                                 // (0, 1); smaller is more conservative
+      double gp_length_scale;    // Kernel length scale, in the unit cube
+      double gp_signal_variance; // Prior variance of the objective, in
+                                 // units of its observed variance
+      double gp_noise_variance;  // Observation noise, in the same units
+                                 // (also keeps the factorization stable)
+      size_t gp_max_points;      // Most observations the GP holds before
+                                 // it drops the older half of them
+      int max_fakes_per_observation; // Most fake values given out per real
+                                     // observation
+    };
+    static constexpr bool observes_all = false;
+
+  public:
+    ObserveUCB(const Options& opt, int dim);
+
+  public:
+    template <typename EvaluateFn>
+    void Observe(std::vector<Node*>* pending, double best_value,
+                 EvaluateFn evaluate)
+    {
+      Screen(*pending, best_value);
+      evaluate(to_evaluate_);
+    }
+    void Record(const Node& node);
+    void Save(BinaryWriter* out) const;
+    void Load(BinaryReader* in);
+    // The GP holds at most gp_max_points observations, so it is saved
+    // with the rest of the state rather than as a table
+    void SaveTables(std::vector<std::string>* tables) const { (void)tables; }
+    void JournalTables(std::vector<std::string>* tables, bool restart)
+      { (void)tables; (void)restart; }
+    void LoadTables(const std::vector<std::string>& tables, size_t* next)
+      { (void)tables; (void)next; }
+
+  public:
+    int num_fake_values() const { return num_fake_values_; }
+
+  protected:
+    void Screen(const std::vector<Node*>& pending, double best_value);
+    double ConfidenceWidth() const;
+
+  protected:
+    // Variables from the options structure
+    double eta_;
+    size_t max_points_;
+    int max_fakes_;
+
+    GaussianProcess gp_;
+    int num_observations_;            // Real observations so far
+    int num_fake_values_;             // Nodes given fake values so far
+    std::vector<double> center_;      // Scratch space for node centers
+    std::vector<Node*> to_evaluate_;  // Nodes that need real values
+};
+
+using BaMSOO = BasicSOO<FewestSplits, SingleDepths, ObserveUCB>;
+
+}
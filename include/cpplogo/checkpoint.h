@@ -0,0 +1,92 @@
+/***********************************************************
+* checkpoint.h
+* The checkpoint file format, and a writer that keeps a
+* checkpoint file up to date from a background thread.
+* A checkpoint is a header followed by frames. Each frame
+* holds the optimizer's small state (counters, random
+* number generators and so on) and the changes to each of
+* its tables since the frame before (see journal.h). The
+* first frame holds every record. Reading a checkpoint
+* folds the frames together, and a frame cut short at the
+* end of the file is ignored, so a file that is appended to
+* is always a complete checkpoint of the last whole frame.
+* CheckpointWriter takes a checkpoint after every step at a
+* cost that depends on what the step changed, not on the
+* size of the node space: only the changes are gathered on
+* the calling thread, and they are handed to the writer
+* thread without being copied. The writer appends them to
+* the file, and folds the file into a single frame again
+* (written to a temporary file and renamed into place) once
+* the appended frames are bigger than the first one.
+***********************************************************/
+#pragma once
+#include "cpplogo/optintf.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cpplogo {
+
+uint64_t WriteCheckpointHeader(std::ostream& os);
+uint64_t WriteCheckpointFrame(const std::string& head,
+                              const std::vector<std::string>& tables,
+                              std::ostream& os);
+void ReadCheckpoint(const std::string& data, std::string* head,
+                    std::vector<std::string>* tables);
+
+class CheckpointWriter {
+  public:
+    CheckpointWriter(const std::string& path);
+    CheckpointWriter(const CheckpointWriter& rhs) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter& rhs) = delete;
+    ~CheckpointWriter();
+
+  public:
+    void Submit(OptIntf* opt);
+    void Wait();
+
+  public:
+    const std::string& path() const { return path_; }
+    size_t num_written() const;
+
+  protected:
+    struct Frame {
+      Frame() : full(false), head(), tables() {}
+      bool full;                       // Does it hold every record?
+      std::string head;                // State that isn't in tables
+      std::vector<std::string> tables; // Changes to each table
+    };
+
+  protected:
+    void WriterLoop();
+    size_t WriteFrames(const std::vector<Frame>& frames);
+    bool WriteSnapshot(const std::string& head,
+                       const std::vector<std::string>& tables);
+    bool Compact();
+
+  protected:
+    std::string path_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Frame> pending_; // Frames waiting to be written, oldest first
+    bool restart_;         // Does the next frame have to hold every record?
+    bool writing_;         // Is the writer thread busy with frames?
+    bool shutdown_;
+    size_t num_written_;   // Number of checkpoints written so far
+
+    // Only used by the writer thread
+    bool broken_;            // Is the file missing changes, so nothing can
+                             // be appended until a full frame arrives?
+    uint64_t first_bytes_;   // Size of the file up to the end of its first
+                             // frame
+    uint64_t file_bytes_;    // ...and its whole size
+    std::thread thread_;   // Declared last so it starts after everything
+                           // else is initialized
+};
+
+}
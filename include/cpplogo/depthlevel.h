@@ -0,0 +1,105 @@
+/***********************************************************
+* depthlevel.h
+* Container for all of the nodes at a single depth of the
+* node space. Keeps the nodes in an indexed max-heap so the
+* best node can be found in constant time and any node can
+* be removed in logarithmic time.
+* The worst nodes of a level can be spilled to a SpillStore
+* to save memory. They are written out best first in blocks
+* of 'c_spill_block_nodes', and the best block is read back
+* whenever its best node could be better than every node
+* left in memory, so Best() is always the best node of the
+* whole level.
+* For checkpoints, a level is a table of its nodes keyed by
+* insertion order. Once its journal is started, every node
+* that is inserted, changed or dropped is recorded, so only
+* those have to be written by the next checkpoint. Spilling
+* and reloading nodes doesn't change the table.
+***********************************************************/
+#pragma once
+#include "cpplogo/journal.h"
+#include "cpplogo/node.h"
+#include "cpplogo/spillstore.h"
+
+#include <cstdint>
+
+namespace cpplogo {
+
+class DepthLevel {
+  public:
+    static constexpr size_t c_spill_block_nodes = 4096;
+
+  public:
+    DepthLevel();
+    DepthLevel(const DepthLevel& rhs) = default;
+    DepthLevel& operator=(const DepthLevel& rhs) = default;
+    DepthLevel(DepthLevel&& rhs) = default;
+    DepthLevel& operator=(DepthLevel&& rhs) = default;
+    ~DepthLevel() = default;
+
+  public:
+    void Insert(const Node& node);
+    void Remove(const Node* node);
+    void Update(const Node* node);
+    void Prune(size_t keep, std::vector<NodeArena::Handle>* removed);
+    void Spill(size_t keep, SpillStore* store,
+               std::vector<NodeArena::Handle>* removed);
+    bool NeedsReload() const;
+    void Reload(NodeArena* arena);
+    const Node* Best() const;
+    Node* Best();
+    void Save(BinaryWriter* out) const;
+    void Load(BinaryReader* in);
+    void SaveTable(std::string* records) const;
+    void LoadTable(const std::string& records, NodeArena* arena);
+    void StartJournal(std::string* records);
+    void TakeChanges(std::string* changes);
+
+  public:
+    size_t size() const { return nodes_.size(); }
+    bool empty() const { return nodes_.empty(); }
+    size_t num_spilled() const { return num_spilled_; }
+    size_t num_bytes() const;
+    static size_t node_bytes()
+      { return sizeof(Node) + sizeof(uint64_t) + 2*sizeof(uint32_t); }
+    std::vector<Node>::const_iterator begin() const { return nodes_.begin(); }
+    std::vector<Node>::const_iterator end() const { return nodes_.end(); }
+
+  protected:
+    struct SpilledBlock {
+      SpillStore::Block block;
+      size_t num_nodes;
+      double best_value;   // Value of the block's best node
+      uint64_t best_order; // ...and its insertion order
+    };
+
+  protected:
+    void Push(const Node& node, uint64_t order);
+    bool Better(size_t slot_a, size_t slot_b) const;
+    static bool Better(double value_a, uint64_t order_a,
+                       double value_b, uint64_t order_b);
+    void SwapHeap(size_t pos_a, size_t pos_b);
+    void SiftUp(size_t pos);
+    void SiftDown(size_t pos);
+    void RankNodes(size_t keep, std::vector<size_t>* slots) const;
+    void KeepSlots(const std::vector<size_t>& slots, size_t keep);
+    size_t BestSpilledBlock() const;
+    void ReleaseSpilled();
+    void JournalSpilled(const SpilledBlock& spilled);
+    void ReadBlock(const SpilledBlock& spilled, NodeArena* arena,
+                   std::vector<Node>* nodes, std::vector<uint64_t>* order)
+      const;
+
+  protected:
+    std::vector<Node> nodes_;       // The nodes themselves, in no order
+    std::vector<uint64_t> order_;   // When each node was inserted
+    std::vector<uint32_t> heap_pos_; // Where each node is in the heap
+    std::vector<uint32_t> heap_;     // Max-heap of indices into nodes_
+    uint64_t next_order_;           // Insertion counter
+    SpillStore* store_;             // Where spilled nodes are, if any
+    std::vector<SpilledBlock> spilled_; // Blocks of spilled nodes
+    size_t num_spilled_;            // Total nodes in them
+    Journal journal_;               // Changes since the last checkpoint
+};
+
+}
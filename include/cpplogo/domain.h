@@ -0,0 +1,60 @@
+/***********************************************************
+* domain.h
+* Maps the unit hypercube the optimizers search onto the
+* domain of the objective.
+* Each dimension has its own bounds, and can be searched on
+* a log scale, where the nodes are split evenly in
+* log(x). The nodes themselves always live in the unit
+* hypercube; only the points handed to the objective (and
+* reported back to the user) are mapped, as their
+* coordinates are computed.
+***********************************************************/
+#pragma once
+#include "cpplogo/types.h"
+
+#include <cmath>
+#include <vector>
+
+namespace cpplogo {
+
+/***********************************************************
+* Bound
+* Range of a single dimension of the domain.
+***********************************************************/
+struct Bound {
+  Bound(double lower, double upper, bool log_scale = false) :
+    lower(lower), upper(upper), log_scale(log_scale) {}
+  double lower;    // Lowest value of the dimension
+  double upper;    // Highest value of the dimension
+  bool log_scale;  // Split the range evenly in log(x)? Needs lower > 0
+};
+
+class Domain {
+  public:
+    Domain(int dim, const std::vector<Bound>& bounds);
+
+  public:
+    double Map(size_t d, double unit) const;
+    vectord Map(const vectord& unit) const;
+
+  protected:
+    // Dimension d maps u to offset + scale*u, and then takes the
+    // exponential of that if it is log scaled
+    std::vector<double> offsets_;
+    std::vector<double> scales_;
+    std::vector<char> log_scales_;
+};
+
+/***********************************************************
+* Map
+* Map coordinate 'unit' of dimension d from the unit
+* hypercube into the domain. The unit hypercube maps onto
+* itself exactly.
+***********************************************************/
+inline double Domain::Map(size_t d, double unit) const
+{
+  double x = offsets_[d] + scales_[d]*unit;
+  return log_scales_[d] ? std::exp(x) : x;
+} /* Map() */
+
+}
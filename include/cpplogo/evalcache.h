@@ -0,0 +1,98 @@
+/***********************************************************
+* evalcache.h
+* Memoizes objective values by the exact point they were
+* observed at, so repeated runs (or restarts) don't pay for
+* the same evaluations twice.
+* The in-memory table holds a bounded number of the most
+* recent entries. Optionally, every new value is also
+* appended to a file that is memory-mapped for lookups, so
+* results survive restarts and can be shared by several
+* processes using the same file. The file's records are
+* found through a fixed-size index, which forgets the
+* oldest records first once it is full, so memory stays
+* bounded however big the file grows. A process indexes its
+* own records as it appends them, and only rescans the file
+* when Refresh() finds that other processes have appended
+* to it too.
+* A cache must only ever be used with one objective.
+***********************************************************/
+#pragma once
+#include "cpplogo/types.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace cpplogo {
+
+class EvaluationCache {
+  public:
+    // 'max_file_entries' bounds the index of the file's records, and is
+    // rounded up to a power of two
+    EvaluationCache(int dim, size_t max_entries, const std::string& path = "",
+                    size_t max_file_entries = 1 << 20);
+    EvaluationCache(const EvaluationCache& rhs) = delete;
+    EvaluationCache& operator=(const EvaluationCache& rhs) = delete;
+    ~EvaluationCache();
+
+  public:
+    bool Lookup(const double* point, double* value);
+    void Insert(const double* point, double value);
+    void Refresh();
+
+  public:
+    int dim() const { return dim_; }
+    size_t num_hits() const
+      { return num_hits_.load(std::memory_order_relaxed); }
+    size_t num_misses() const
+      { return num_misses_.load(std::memory_order_relaxed); }
+
+  protected:
+    // Slot of the file index. An offset of 0 marks an empty slot, since
+    // records always come after the header.
+    struct FileSlot {
+      uint64_t hash;
+      uint64_t offset;
+    };
+
+  protected:
+    uint64_t Hash(const double* point) const;
+    bool LookupMemory(uint64_t hash, const double* point, double* value) const;
+    void InsertMemory(uint64_t hash, const double* point, double value);
+    bool FindInFile(uint64_t hash, const double* point, double* value);
+    void IndexRecord(uint64_t hash, size_t offset);
+    void OpenFile(const std::string& path);
+    void MapFile();
+
+  protected:
+    std::mutex mutex_;
+    int dim_;
+    size_t max_entries_;
+
+    // In-memory table: a ring of entries, oldest overwritten first
+    std::vector<double> points_;   // dim_ coordinates per entry
+    std::vector<double> values_;
+    std::vector<uint64_t> hashes_;
+    size_t next_entry_;            // Entry that will be overwritten next
+    std::unordered_map<uint64_t, size_t> table_; // Point hash -> entry
+
+    // Persistent store
+    int fd_;                       // File descriptor, or -1 if no file
+    char* map_;                    // Read-only mapping of the file
+    size_t map_size_;
+    size_t indexed_size_;          // Bytes of the file scanned so far
+    size_t known_size_;            // indexed_size_ plus our own appends since
+    std::vector<FileSlot> file_index_; // Probe table of point hash -> offset
+                                       // of its record
+    size_t file_index_mask_;
+    std::vector<double> record_;   // Scratch space for one record
+
+    // Updated under mutex_, but read without it while other threads look
+    // points up
+    std::atomic<size_t> num_hits_;
+    std::atomic<size_t> num_misses_;
+};
+
+}
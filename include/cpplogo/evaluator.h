@@ -0,0 +1,196 @@
+/***********************************************************
+* evaluator.h
+* Strategies for evaluating the objective function on a
+* batch of points at once.
+***********************************************************/
+#pragma once
+#include "cpplogo/types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <sys/types.h>
+
+namespace cpplogo {
+
+/***********************************************************
+* Evaluator
+* Evaluates an objective on every row of a matrix of points.
+* Implementations may evaluate the points in any order or
+* concurrently, but value i must always belong to row i.
+* Every evaluator here can be shared between optimizers
+* (e.g. through copied options or in a portfolio); the
+* pools evaluate one batch at a time, so sharing one means
+* batches from different threads wait for each other.
+* An evaluator that can only run an objective fixed in
+* advance says so through runs_any_fn(), so optimizers can
+* refuse to hand it other functions.
+***********************************************************/
+class Evaluator {
+  public:
+    virtual ~Evaluator() = default;
+
+  public:
+    virtual void Evaluate(const ObjectiveFn& fn, const matrixd& points,
+                          vectord* values) = 0;
+    virtual bool runs_any_fn() const { return true; }
+};
+
+/***********************************************************
+* SerialEvaluator
+* Evaluates each point in turn on the calling thread.
+***********************************************************/
+class SerialEvaluator : public Evaluator {
+  public:
+    SerialEvaluator() = default;
+    virtual ~SerialEvaluator() = default;
+
+  public:
+    void Evaluate(const ObjectiveFn& fn, const matrixd& points,
+                  vectord* values) override;
+};
+
+/***********************************************************
+* ThreadPoolEvaluator
+* Spreads the points of a batch over a fixed set of worker
+* threads. The calling thread takes part in the work too, so
+* a pool with one thread behaves like SerialEvaluator.
+* Only as many workers as there are points besides the
+* caller's first one are woken for a batch, and workers
+* that haven't woken up by the time the caller runs out of
+* points are left asleep.
+***********************************************************/
+class ThreadPoolEvaluator : public Evaluator {
+  public:
+    // A thread count of 0 uses one thread per hardware core
+    ThreadPoolEvaluator(size_t num_threads = 0);
+    ThreadPoolEvaluator(const ThreadPoolEvaluator& rhs) = delete;
+    ThreadPoolEvaluator& operator=(const ThreadPoolEvaluator& rhs) = delete;
+    virtual ~ThreadPoolEvaluator();
+
+  public:
+    void Evaluate(const ObjectiveFn& fn, const matrixd& points,
+                  vectord* values) override;
+
+  public:
+    size_t num_threads() const { return workers_.size()+1; }
+
+  protected:
+    void WorkerLoop();
+    void RunBatch(vectord* point);
+
+  protected:
+    std::vector<std::thread> workers_;
+    vectord point_; // The calling thread's buffer for passing points to
+                    // the objective
+    std::mutex batch_mutex_; // Held for a whole batch, so callers on
+                             // different threads take turns
+    std::mutex mutex_;
+    std::condition_variable work_cv_; // Signals workers that a batch is ready
+    std::condition_variable done_cv_; // Signals the caller a batch is done
+
+    // State of the batch currently being evaluated
+    const ObjectiveFn* fn_;
+    const matrixd* points_;
+    vectord* values_;
+    std::atomic<size_t> next_point_; // Index of the next unclaimed point
+    size_t batch_id_;                // Incremented every time a batch starts
+    size_t open_slots_;              // Workers that may still join it
+    size_t busy_workers_;            // Workers still inside this batch
+    std::exception_ptr error_;       // First exception thrown by the objective
+    bool shutdown_;
+};
+
+
+/***********************************************************
+* ProcessPoolEvaluator
+* Evaluates the points in a pool of forked worker processes,
+* for objectives that aren't thread-safe, leak memory, or
+* may crash. Each worker gets one point at a time over a
+* Unix socket and sends back its value; the values are
+* always stored by row, so the optimizer records them in
+* the same order whichever worker finishes first.
+* A worker that dies is replaced and its point is sent to
+* another worker, up to 'max_attempts' times per point.
+* Workers can also be replaced after a fixed number of
+* evaluations, to put a bound on leaks.
+* The workers are forked with the objective given to the
+* constructor, which is the one they evaluate; the 'fn'
+* passed to Evaluate is ignored, and runs_any_fn() is false
+* so that optimizers reject fidelity ladders that would
+* need it to run other functions.
+* Forking a process that has other threads running is only
+* safe if the child doesn't touch locks those threads may
+* have held. So the constructor forks a single fork server,
+* and every worker (including replacements in the middle of
+* a run) is forked by the server instead, which never has
+* more than one thread. The server passes the socket to
+* each new worker back over its own socket, and reaps the
+* workers when asked to. The server itself is forked from
+* the calling thread, so evaluators must be created before
+* any other threads are started (or while none are
+* running). The server and each worker close every file
+* descriptor they inherit except the standard streams and
+* their own socket, so pools don't keep each other's
+* workers alive. Workers that don't exit when they are
+* stopped are killed after a grace period.
+***********************************************************/
+class ProcessPoolEvaluator : public Evaluator {
+  public:
+    // A worker count of 0 uses one worker per hardware core, and a limit of
+    // 0 evaluations per worker never replaces healthy workers
+    ProcessPoolEvaluator(ObjectiveFn fn, size_t num_workers = 0,
+                         size_t max_evaluations_per_worker = 0,
+                         int max_attempts = 3);
+    ProcessPoolEvaluator(const ProcessPoolEvaluator& rhs) = delete;
+    ProcessPoolEvaluator& operator=(const ProcessPoolEvaluator& rhs) = delete;
+    virtual ~ProcessPoolEvaluator();
+
+  public:
+    void Evaluate(const ObjectiveFn& fn, const matrixd& points,
+                  vectord* values) override;
+    bool runs_any_fn() const override { return false; }
+
+  public:
+    size_t num_workers() const { return workers_.size(); }
+    size_t num_restarts() const { return num_restarts_; }
+
+  protected:
+    struct Worker {
+      Worker() : pid(-1), fd(-1), num_evaluations(0), point(-1) {}
+      pid_t pid;              // Process ID of the worker
+      int fd;                 // Our end of the socket to the worker
+      size_t num_evaluations; // Points the worker has evaluated
+      long point;             // Row the worker is evaluating, or -1
+    };
+
+  protected:
+    void StartWorker(Worker* worker);
+    void StopWorker(Worker* worker, bool kill_worker);
+    void Dispatch(Worker* worker, const matrixd& points);
+    void Abort();
+    void Shutdown();
+    [[noreturn]] static void ServerMain(const ObjectiveFn& fn, int fd);
+    [[noreturn]] static void WorkerMain(const ObjectiveFn& fn, int fd);
+
+  protected:
+    ObjectiveFn fn_;
+    pid_t server_pid_;       // Process ID of the fork server
+    int server_fd_;          // Our end of the socket to the fork server
+    std::mutex batch_mutex_; // Held for a whole batch
+    size_t max_evaluations_per_worker_;
+    int max_attempts_;
+    std::vector<Worker> workers_;
+    size_t num_restarts_; // Workers replaced after dying
+
+    // State of the batch currently being evaluated
+    size_t next_point_;         // Next row that hasn't been sent out
+    std::deque<size_t> retry_;  // Rows whose worker died, to send again
+    std::vector<int> attempts_; // Times each row has been sent out
+    std::vector<char> request_; // Buffer for sending points
+};
+
+}
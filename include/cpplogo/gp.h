@@ -0,0 +1,62 @@
+/***********************************************************
+* gp.h
+* A Gaussian process regression model that is updated one
+* observation at a time.
+* The Cholesky factor of the kernel matrix is extended by a
+* single row for each new observation instead of being
+* refactored, so adding the n-th observation and predicting
+* at a point both cost O(n^2) rather than O(n^3).
+* The kernel is a squared exponential with fixed
+* hyperparameters, fit to the observations after they are
+* standardized by their mean and standard deviation, so the
+* signal variance and noise don't depend on the scale of
+* the objective. Keeping L^-1 y and L^-1 1 separately lets
+* the standardization change with every observation without
+* refactoring.
+***********************************************************/
+#pragma once
+#include "cpplogo/serialize.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace cpplogo {
+
+class GaussianProcess {
+  public:
+    GaussianProcess(int dim, double length_scale, double signal_variance,
+                    double noise_variance);
+
+  public:
+    bool Add(const double* point, double value);
+    void Shrink(size_t num_keep);
+    void Predict(const double* point, double* mean, double* variance);
+    void Save(BinaryWriter* out) const;
+    void Load(BinaryReader* in);
+
+  public:
+    size_t size() const { return values_.size(); }
+
+  protected:
+    double Kernel(const double* a, const double* b) const;
+    double scale() const;
+    void SolveLower(const double* point);
+
+  protected:
+    int dim_;
+    double inv_length_scale2_; // 1 / length scale^2
+    double signal_variance_;
+    double noise_variance_;
+
+    double mean_;                  // Mean of the values
+    double m2_;                    // Sum of squared differences from mean_
+    std::vector<double> points_;   // dim_ coordinates per observation
+    std::vector<double> values_;
+    std::vector<double> chol_;     // Lower triangular Cholesky factor L of
+                                   // the kernel matrix, packed by rows
+    std::vector<double> weights_;  // L^-1 values
+    std::vector<double> ones_;     // L^-1 1
+    std::vector<double> solved_;   // Scratch space for L^-1 k(X, point)
+};
+
+}
@@ -0,0 +1,64 @@
+/***********************************************************
+* journal.h
+* Records the changes made to a table of keyed records, so
+* a checkpoint can be brought up to date by writing only
+* what changed since the last one. A change either puts a
+* record under a key, replacing whatever was there, or
+* erases the key.
+* Changes are kept as a string of entries: the key, then
+* the size of the record plus one (0 for an erase), then the
+* record's bytes. A whole table is written the same way, as
+* one put per record, so bringing a table up to date is the
+* same as folding lists of changes together.
+***********************************************************/
+#pragma once
+#include "cpplogo/serialize.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpplogo {
+
+class Journal {
+  public:
+    Journal();
+
+  public:
+    void Start();
+    void Stop();
+    template <typename WriteFn>
+    void Put(uint64_t key, WriteFn write);
+    void Erase(uint64_t key);
+    void Take(std::string* changes);
+    static uint64_t ReadKey(BinaryReader* in);
+    static void Fold(std::vector<BinaryReader>* changes, std::string* table);
+
+  public:
+    bool active() const { return active_; }
+
+  protected:
+    bool active_;         // Are changes being recorded?
+    std::string changes_; // Changes since Start or the last Take
+    std::string record_;  // Scratch space for the record being put
+};
+
+/***********************************************************
+* Put
+* Record that the record written by 'write' (given a
+* BinaryWriter) is now the one under 'key'.
+***********************************************************/
+template <typename WriteFn>
+void Journal::Put(uint64_t key, WriteFn write)
+{
+  record_.clear();
+  BinaryWriter record(&record_);
+  write(&record);
+
+  BinaryWriter out(&changes_);
+  out.WriteUInt(key);
+  out.WriteUInt(record_.size() + 1);
+  out.WriteBytes(record_);
+} /* Put() */
+
+}
@@ -0,0 +1,76 @@
+/***********************************************************
+* kdtree.h
+* A k-d tree of points with values, for finding the nearest
+* neighbours of a point among many observations.
+* Points are inserted one at a time and the tree is rebuilt
+* balanced whenever it has doubled in size, so insertions
+* are amortized O(log n) and queries stay logarithmic no
+* matter what order the points arrive in.
+* For checkpoints, the points are a table keyed by their
+* insertion order, and only the ones inserted since the
+* last checkpoint are journaled.
+***********************************************************/
+#pragma once
+#include "cpplogo/journal.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cpplogo {
+
+class KDTree {
+  public:
+    struct Neighbour {
+      size_t index;  // Which point it is, in insertion order
+      double dist2;  // Squared distance to the query
+    };
+
+  public:
+    KDTree(int dim);
+
+  public:
+    void Insert(const double* point, double value);
+    void Nearest(const double* point, size_t k,
+                 std::vector<Neighbour>* neighbours,
+                 double approximation = 0.0) const;
+    void Clear();
+    void SaveTable(std::string* records) const;
+    void LoadTable(const std::string& records);
+    void StartJournal(std::string* records);
+    void TakeChanges(std::string* changes);
+
+  public:
+    int dim() const { return dim_; }
+    size_t size() const { return values_.size(); }
+    const double* point(size_t i) const { return &points_[i*dim_]; }
+    double value(size_t i) const { return values_[i]; }
+
+  protected:
+    struct TreeNode {
+      int split_dim;  // Dimension the node splits its subtree on
+      int32_t left;   // Points below the node's point along split_dim
+      int32_t right;  // ...and the rest, or -1 if empty
+    };
+
+  protected:
+    void Rebuild();
+    int32_t Build(uint32_t* begin, uint32_t* end);
+    void Search(int32_t node, const double* point, size_t k,
+                double scale, double rect_dist2, double* offsets,
+                std::vector<Neighbour>* neighbours) const;
+
+  protected:
+    int dim_;
+    std::vector<double> points_;   // dim_ coordinates per point
+    std::vector<double> values_;
+    std::vector<TreeNode> nodes_;  // One per point, in the same order
+    int32_t root_;                 // Point at the root, or -1 if empty
+    size_t rebuild_size_;          // Size at which to rebuild next
+    std::vector<uint32_t> order_;  // Scratch space for rebuilding
+    Journal journal_;              // Points inserted since the last
+                                   // checkpoint
+};
+
+}
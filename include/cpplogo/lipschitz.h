@@ -0,0 +1,95 @@
+/***********************************************************
+* lipschitz.h
+* An observation policy that skips the evaluation of nodes
+* which a Lipschitz bound from their nearest observed
+* neighbours says can't beat the best observation so far.
+***********************************************************/
+#pragma once
+#include "cpplogo/soo.h"
+#include "cpplogo/kdtree.h"
+
+namespace cpplogo {
+
+/***********************************************************
+* ObserveLipschitz
+* Observation policy: before evaluating a node, look up the
+* nearest observed centers in a k-d tree and bound the
+* node's value from above by
+*   min_i (f(x_i) + L |x - x_i|)
+* over those neighbours. If the bound is below the best
+* value observed so far, the node gets a fake value instead:
+* the inverse-distance weighted mean of its neighbours'
+* values, capped at the bound.
+* L is 'lipschitz_constant' when that is positive. Otherwise
+* it is estimated as 'lipschitz_factor' times the steepest
+* slope seen between any observation and its nearest
+* neighbour at the time it was made. Nothing is screened
+* until there are 'screen_neighbours' observations and a
+* nonzero L.
+* The bound holds for any set of observations, so the
+* neighbours only need to be roughly the nearest ones: an
+* approximate search keeps queries fast in higher
+* dimensions at the cost of a slightly looser bound.
+***********************************************************/
+class ObserveLipschitz {
+  public:
+    struct Options {
+      using Args = std::tuple<>;
+      Options() :
+        lipschitz_constant(0.0), lipschitz_factor(2.0), screen_neighbours(8),
+        screen_approximation(1.0)
+      {}
+      double lipschitz_constant; // Known Lipschitz constant of the
+                                 // objective in the unit cube, or 0
+                                 // to estimate it
+      double lipschitz_factor;   // Safety factor on the estimated constant
+      size_t screen_neighbours;  // Neighbours each node is compared with
+      double screen_approximation; // How much further away than the true
+                                   // nearest neighbours the ones used may
+                                   // be, relatively (see KDTree::Nearest)
+    };
+    static constexpr bool observes_all = false;
+
+  public:
+    ObserveLipschitz(const Options& opt, int dim);
+
+  public:
+    template <typename EvaluateFn>
+    void Observe(std::vector<Node*>* pending, double best_value,
+                 EvaluateFn evaluate)
+    {
+      Screen(*pending, best_value);
+      evaluate(to_evaluate_);
+    }
+    void Record(const Node& node);
+    void Save(BinaryWriter* out) const;
+    void Load(BinaryReader* in);
+    void SaveTables(std::vector<std::string>* tables) const;
+    void JournalTables(std::vector<std::string>* tables, bool restart);
+    void LoadTables(const std::vector<std::string>& tables, size_t* next);
+
+  public:
+    double lipschitz_constant() const;
+    int num_fake_values() const { return num_fake_values_; }
+
+  protected:
+    void Screen(const std::vector<Node*>& pending, double best_value);
+
+  protected:
+    // Variables from the options structure
+    double fixed_constant_;
+    double factor_;
+    size_t num_neighbours_;
+    double approximation_;
+
+    KDTree tree_;                     // Every real observation so far
+    double max_slope_;                // Steepest slope seen so far
+    int num_fake_values_;             // Nodes given fake values so far
+    std::vector<double> center_;      // Scratch space for node centers
+    std::vector<KDTree::Neighbour> neighbours_; // ...and for queries
+    std::vector<Node*> to_evaluate_;  // Nodes that need real values
+};
+
+using LipschitzSOO = BasicSOO<FewestSplits, SingleDepths, ObserveLipschitz>;
+
+}
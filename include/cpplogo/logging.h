@@ -20,6 +20,28 @@ enum log_severity_level
 
 void init_logging(log_severity_level l);
 
+// Log levels below this are compiled out completely. Set through the
+// CPPLOGO_MIN_LOG_LEVEL CMake option.
+#ifndef _CPPLOGO_MIN_LOG_LEVEL
+#define _CPPLOGO_MIN_LOG_LEVEL trace
+#endif
+constexpr log_severity_level c_min_log_level = _CPPLOGO_MIN_LOG_LEVEL;
+
+// Log levels below this are dropped at runtime. Set by init_logging.
+extern log_severity_level min_log_level;
+
+/***********************************************************
+* log_enabled
+* Returns true if messages at 'level' will be emitted.
+* This is checked before anything is handed to the logging
+* library, so a disabled LOG() statement never evaluates or
+* formats its arguments.
+***********************************************************/
+inline bool log_enabled(log_severity_level level)
+{
+  return level >= c_min_log_level && level >= min_log_level;
+}
+
 }
 
 #ifdef _CPPLOGO_ENABLE_LOGGING
@@ -36,7 +58,8 @@ BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(
   log, 
   boost::log::sources::severity_logger<cpplogo::log_severity_level>
 )
-#define LOG(x) BOOST_LOG_SEV(log::get(), x)
+#define LOG(x) \
+  if (!cpplogo::log_enabled(x)) {} else BOOST_LOG_SEV(log::get(), x)
 
 #else
 
@@ -47,6 +70,6 @@ namespace cpplogo {
 extern boost::iostreams::stream<boost::iostreams::null_sink> null_stream;
 }
 
-#define LOG(x) cpplogo::null_stream
+#define LOG(x) if (true) {} else cpplogo::null_stream
 
 #endif
@@ -7,28 +7,34 @@
 
 namespace cpplogo {
 
-class LOGO : virtual public SOO {
+/***********************************************************
+* DepthSets
+* Depth set policy: groups 'w' consecutive depths into a
+* single set, and adapts 'w' after every step according to
+* a schedule, as in LOGO.
+***********************************************************/
+class DepthSets {
 /***********************************************************
 * Options structure
 ***********************************************************/
   public:
-    struct Options : virtual public SOO::Options {
-      Options(ObjectiveFn fn, int dim, int max_observations, 
-              int num_children, std::vector<int> w_schedule) :
-        SOO::Options(fn, dim, max_observations, num_children),
-        w_schedule(w_schedule)
-      {}
+    struct Options {
+      using Args = std::tuple<std::vector<int>>;
+      Options(std::vector<int> w_schedule) : w_schedule(w_schedule) {}
       std::vector<int> w_schedule; // List of W values to move through
     };
 
   public:
-    LOGO(const Options& opt);
-    virtual ~LOGO() = default;
+    DepthSets(const Options& opt, int dim);
 
-  protected:
-    void EndStep() override;
-    size_t CalculateMaxDepth() const override;
-    const Node* BestNodeAtDepth(size_t depthset_id) const override;
+  public:
+    size_t MaxDepth(size_t max_depth) const;
+    size_t DeepestDepth(size_t max_depth) const;
+    const Node* Best(const std::vector<DepthLevel>& space,
+                     size_t depthset_id) const;
+    void EndStep(const std::vector<Node>& step_observed_nodes);
+    void Save(BinaryWriter* out) const;
+    void Load(BinaryReader* in);
 
   protected:
     // Variables from the options structure
@@ -38,4 +44,6 @@ class LOGO : virtual public SOO {
     double last_best_obs_; // Best value observed in the previous step
 };
 
+using LOGO = BasicSOO<FewestSplits, DepthSets, ObserveCenters>;
+
 }
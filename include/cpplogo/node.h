@@ -1,41 +1,59 @@
 /***********************************************************
 * node.h
 * Class that represents a single node in the function space.
+* The node's geometry lives in a NodeArena; the node itself
+* only holds a handle to it, so nodes are cheap to copy.
+* Edges, sizes and centers are all computed on demand from
+* the arena's integer cell codes.
 ***********************************************************/
 #pragma once
 #include "cpplogo/types.h"
+#include "cpplogo/nodearena.h"
+#include "cpplogo/serialize.h"
 
 namespace cpplogo {
 
 class Node {
   public:
-    Node(vectord edges, vectord sizes, int depth);
+    Node(const NodeArena* arena, NodeArena::Handle handle, int depth);
     Node(const Node& rhs) = default;
     Node& operator=(const Node& rhs) = default;
     Node(Node&& rhs) = default;
     Node& operator=(Node&& rhs) = default;
-    virtual ~Node() = default;
+    ~Node() = default;
 
   public:
     void SetValue(double value);
     void SetFakeValue(double value);
+    void SetLowFidelityValue(double value);
     vectord Center() const;
+    vectord edges() const;
+    vectord sizes() const;
+    void Save(BinaryWriter* out) const;
+    static Node Load(BinaryReader* in, NodeArena* arena);
 
   public:
-    const vectord& edges() const { return edges_; }
-    const vectord& sizes() const { return sizes_; }
+    double edge(size_t d) const { return arena_->edge(handle_, d); }
+    double size(size_t d) const { return arena_->size(handle_, d); }
+    double center(size_t d) const { return arena_->center(handle_, d); }
+    int splits(size_t d) const { return arena_->splits(handle_, d); }
+    NodeArena::Code code(size_t d) const { return arena_->code(handle_, d); }
+    int dim() const { return arena_->dim(); }
+    NodeArena::Handle handle() const { return handle_; }
     int depth() const { return depth_; }
     double value() const { return value_; }
     bool has_value() const { return has_value_; }
     bool is_fake_value() const { return is_fake_value_; }
+    bool is_low_fidelity() const { return is_low_fidelity_; }
 
   protected:
-    vectord edges_;      // Edge of the node for each dimension
-    vectord sizes_;      // Size of the node in each dimension
+    const NodeArena* arena_;   // Where the node's geometry is stored
+    NodeArena::Handle handle_; // Slot of the node's geometry in the arena
     int depth_;          // Depth of the node in the node space
     double value_;       // Value of the function at the node's center
     bool has_value_;     // Does the node have a value?
     bool is_fake_value_; // Is the node's vaule fake? (for BaMSOO)
+    bool is_low_fidelity_; // Is the value from a low fidelity objective?
 };
 
 std::ostream& operator<<(std::ostream& os, const Node& n);
@@ -0,0 +1,200 @@
+/***********************************************************
+* nodearena.h
+* Storage for the geometry of every node in the node space.
+* Each dimension of the geometry is kept in its own flat
+* buffer (structure-of-arrays), and nodes refer to their
+* slot in those buffers through a stable handle. Slots of
+* removed nodes are recycled, so once the arena has grown
+* to its working size it stops allocating.
+*
+* Since every split divides one dimension into
+* 'num_children' equal parts, a node's extent along a
+* dimension is fully described by how many times that
+* dimension has been split (k) and which of the resulting
+* cells the node is in (c). Both are packed into a single
+* integer code, num_children^k + c, and the edges, sizes and
+* centers are derived from it on demand. Splitting a cell
+* into its children is then just code*num_children + i.
+* Codes are stored as narrow as every code in the arena
+* allows (1, 2, 4 or 8 bytes), so shallow trees in high
+* dimensions only take a byte or two per dimension. The
+* buffers are widened when a split needs more bits, which
+* happens at most three times per run, and a split that
+* would need more than 64 bits throws. max_splits() tells
+* the optimizers when a dimension can't be split any
+* further, so they can stop expanding the node instead.
+***********************************************************/
+#pragma once
+#include "cpplogo/types.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace cpplogo {
+
+class NodeArena {
+  public:
+    using Handle = uint32_t;
+    using Code = uint64_t;
+
+  public:
+    NodeArena(int dim, int num_children);
+
+  public:
+    Handle Allocate();
+    void Retire(Handle handle);
+    void Recycle();
+    void InitRoot(Handle handle);
+    void CopyGeometry(Handle from, Handle to);
+    void Split(Handle handle, size_t d, int child);
+    void SetCode(Handle handle, size_t d, Code code);
+
+  public:
+    int dim() const { return dim_; }
+    int num_children() const { return num_children_; }
+    size_t capacity() const { return num_slots_; }
+    size_t num_live() const { return num_slots_-free_.size()-retired_.size(); }
+    size_t num_bytes() const;
+    size_t code_bytes() const { return code_bytes_; }
+    int max_splits() const { return max_splits_; }
+    Code code(Handle handle, size_t d) const;
+    int splits(Handle handle, size_t d) const;
+    double edge(Handle handle, size_t d) const;
+    double size(Handle handle, size_t d) const;
+    double center(Handle handle, size_t d) const;
+
+  protected:
+    void Decode(Code code, int* splits, Code* cell) const;
+    static Code ReadCode(const uint8_t* bytes, size_t width);
+    static void WriteCode(uint8_t* bytes, size_t width, Code code);
+    void Store(Handle handle, size_t d, Code code);
+    void Widen(Code code);
+
+  protected:
+    int dim_;
+    int num_children_;
+    size_t num_slots_;                     // Total number of slots
+    std::vector<std::vector<uint8_t>> codes_; // Cell codes, one buffer per
+                                              // dimension
+    size_t code_bytes_;                    // Bytes per code in the buffers
+    Code max_stored_code_;                 // Largest code that fits in them
+    std::vector<Handle> free_;             // Slots ready to be reused
+    std::vector<Handle> retired_;          // Slots that can be reused after
+                                           // the next call to Recycle
+    std::vector<Code> powers_;             // num_children^k for every k that
+                                           // fits in a code
+    std::vector<int> splits_for_bits_;     // Largest k with num_children^k
+                                           // below 2^b, for each bit count b
+    Code max_split_code_;                  // Codes above this can't be split
+                                           // any further
+    int max_splits_;                       // Every cell split fewer times
+                                           // than this can be split again
+};
+
+/***********************************************************
+* The accessors below are used in the innermost loops of
+* the optimizers, so they are defined here to be inlined.
+***********************************************************/
+
+/***********************************************************
+* ReadCode
+* Read a code stored in 'width' bytes.
+***********************************************************/
+inline NodeArena::Code NodeArena::ReadCode(const uint8_t* bytes, size_t width)
+{
+  switch (width) {
+    case 1:
+      return *bytes;
+    case 2: {
+      uint16_t code;
+      std::memcpy(&code, bytes, sizeof(code));
+      return code;
+    }
+    case 4: {
+      uint32_t code;
+      std::memcpy(&code, bytes, sizeof(code));
+      return code;
+    }
+    default: {
+      uint64_t code;
+      std::memcpy(&code, bytes, sizeof(code));
+      return code;
+    }
+  }
+} /* ReadCode() */
+
+/***********************************************************
+* code
+* Cell code of a node along dimension d.
+***********************************************************/
+inline NodeArena::Code NodeArena::code(Handle handle, size_t d) const
+{
+  return ReadCode(codes_[d].data() + handle*code_bytes_, code_bytes_);
+} /* code() */
+
+/***********************************************************
+* splits
+* Number of times a node has been split along dimension d.
+***********************************************************/
+inline int NodeArena::splits(Handle handle, size_t d) const
+{
+  int splits;
+  Code cell;
+  Decode(code(handle, d), &splits, &cell);
+  return splits;
+} /* splits() */
+
+/***********************************************************
+* edge
+* Lower edge of a node along dimension d.
+***********************************************************/
+inline double NodeArena::edge(Handle handle, size_t d) const
+{
+  int splits;
+  Code cell;
+  Decode(code(handle, d), &splits, &cell);
+  return cell / static_cast<double>(powers_[splits]);
+} /* edge() */
+
+/***********************************************************
+* size
+* Size of a node along dimension d.
+***********************************************************/
+inline double NodeArena::size(Handle handle, size_t d) const
+{
+  return 1.0 / powers_[splits(handle, d)];
+} /* size() */
+
+/***********************************************************
+* center
+* Center of a node along dimension d.
+***********************************************************/
+inline double NodeArena::center(Handle handle, size_t d) const
+{
+  int splits;
+  Code cell;
+  Decode(code(handle, d), &splits, &cell);
+  return (cell + 0.5) / powers_[splits];
+} /* center() */
+
+/***********************************************************
+* Decode
+* Split a cell code back up into the number of splits and
+* the cell index.
+***********************************************************/
+inline void NodeArena::Decode(Code code, int* splits, Code* cell) const
+{
+  assert(code > 0);
+  // num_children^k <= code < 2*num_children^k, so the position of the
+  // highest bit narrows k down to at most two candidates
+  int bits = 63 - __builtin_clzll(code);
+  int k = splits_for_bits_[bits];
+  if (k+1 < static_cast<int>(powers_.size()) && powers_[k+1] <= code) {
+    k++;
+  }
+  *splits = k;
+  *cell = code - powers_[k];
+} /* Decode() */
+
+}
@@ -3,13 +3,67 @@
 * Defines the basic interface and high-level functionality
 * for any SOO-like optimization algorithms that will be 
 * implemented.
+* The algorithms never call the objective themselves: a
+* step runs until it needs values for a batch of points,
+* hands the points out through Ask(), and carries on once
+* Tell() gives it their values. Step() and Optimize() drive
+* that loop with the objective in the options structure,
+* and callers that evaluate points elsewhere (e.g. through
+* a job scheduler) can use Ask() and Tell() directly.
+* Besides the budget of observations, which is only checked
+* between steps, a run can be stopped early by a deadline,
+* a target value or a stall. These are checked before every
+* batch of points, so they can cut a step short; the best
+* point found so far is always available. So is a stop flag
+* that another thread can set (e.g. a portfolio stopping
+* all of its members).
+* A ladder of cheaper, lower fidelity versions of the
+* objective can be given too. Algorithms decide which one
+* each point is evaluated with, and Ask() says which one
+* the points it returns are for.
 ***********************************************************/
 #pragma once
 #include "cpplogo/types.h"
+#include "cpplogo/domain.h"
+#include "cpplogo/evaluator.h"
+#include "cpplogo/evalcache.h"
+#include "cpplogo/serialize.h"
+#include "cpplogo/stats.h"
+#include "cpplogo/trace.h"
+
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace cpplogo {
 
 class OptIntf {
+/***********************************************************
+* Fidelity
+* One rung of the ladder of low fidelity objectives. A node
+* is evaluated with the first rung (cheapest first) whose
+* rule it satisfies: it is no deeper than 'max_depth' and
+* its largest side in the unit hypercube is at least
+* 'min_size'. Nodes that satisfy no rule are evaluated with
+* the objective itself.
+***********************************************************/
+  public:
+    struct Fidelity {
+      Fidelity(ObjectiveFn fn, int max_depth, double min_size = 0.0) :
+        fn(fn), batch_fn(), max_depth(max_depth), min_size(min_size) {};
+      ObjectiveFn fn;            // Approximation of the objective, on the
+                                 // same scale. May be empty if only
+                                 // Ask/Tell are used.
+      BatchObjectiveFn batch_fn; // Optional batch version, used instead of
+                                 // fn when set
+      int max_depth;             // Deepest node it evaluates
+      double min_size;           // Smallest largest side of a node it
+                                 // evaluates
+    };
+
 /***********************************************************
 * Options structure
 * A collection of information required for the optimization.
@@ -19,13 +73,51 @@ class OptIntf {
   public:
     struct Options {
       Options(ObjectiveFn fn, int dim, int max_observations) :
-        fn(fn), dim(dim), max_observations(max_observations) {};
-      ObjectiveFn fn;       // Objective function to optimize
+        fn(fn), dim(dim), max_observations(max_observations), bounds(),
+        batch_fn(),
+        evaluator(), cache(), trace(), max_seconds(0.0),
+        target_value(std::numeric_limits<double>::infinity()),
+        stall_observations(0), stall_tolerance(0.0), fidelities() {};
+      ObjectiveFn fn;       // Objective function to optimize. May be empty
+                            // if only Ask/Tell are used.
       int dim;              // Dimensionality of objective
       int max_observations; // Maximum number of function observations before
                             // stopping
+      std::vector<Bound> bounds; // Domain of each dimension of the objective
+                                 // (empty for the unit hypercube)
+      BatchObjectiveFn batch_fn; // Optional version of the objective that
+                                 // evaluates many points at once. Used
+                                 // instead of fn/evaluator when set.
+      std::shared_ptr<Evaluator> evaluator; // How batches of points are
+                                            // evaluated. Defaults to a
+                                            // ThreadPoolEvaluator if there
+                                            // is an fn.
+      std::shared_ptr<EvaluationCache> cache; // Optional memo of previously
+                                              // observed values
+      std::shared_ptr<TraceWriter> trace; // Optional binary trace of every
+                                          // observation
+      double max_seconds;     // Wall time the run may take, counted from the
+                              // first Step/Ask (0 for no deadline)
+      double target_value;    // Stop once the best value reaches this
+      int stall_observations; // Stop after this many observations without
+                              // an improvement (0 to never stop)
+      double stall_tolerance; // How much the best value has to go up by to
+                              // count as an improvement
+      std::vector<Fidelity> fidelities; // Ladder of low fidelity objectives,
+                                        // cheapest first (empty for none)
     };
 
+    // Why a run is finished
+    enum class StopReason {
+      none, observations, deadline, target, stall, stopped
+    };
+
+    // Called before every batch of points with the number of them that are
+    // for the objective. Returns why the run should stop instead, if it
+    // should.
+    using BatchHook = std::function<StopReason(const OptIntf& alg,
+                                               int num_points)>;
+
   public:
     OptIntf(const Options& opt);
     virtual ~OptIntf() = default;
@@ -33,24 +125,150 @@ class OptIntf {
   public:
     void Optimize();
     void Step();
+    const matrixd& Ask();
+    void Tell(const vectord& values);
     bool IsFinished() const;
+    StopReason stop_reason() const;
+    void Save(std::ostream& os) const;
+    void Load(std::istream& is);
+    bool SaveChanges(std::string* head, std::vector<std::string>* tables,
+                     bool restart);
+    void SetStopFlag(std::shared_ptr<const std::atomic<bool>> stop_flag);
+    void SetBatchHook(BatchHook hook);
 
   public:
     int num_observations() const { return num_observations_; }
+    uint64_t num_steps() const { return num_steps_; }
+    bool waiting() const { return waiting_; }
+    int ask_fidelity() const { return ask_fidelity_; }
+    double elapsed_seconds() const;
+    const Stats& stats() const { return stats_; }
+    virtual double best_value() const = 0;
+
+  protected:
+    // The parts of a step, in order
+    enum class StepPhase { begin, expand, flush, end };
 
   protected:
+    virtual bool Advance();
+    virtual void ReceiveValues(const vectord& values) = 0;
     virtual void BeginStep() = 0;
     virtual void EndStep() = 0;
     virtual size_t CalculateMaxDepth() const = 0;
-    virtual void ExpandBestAtDepth(size_t depth) = 0;
+    virtual bool ExpandBestAtDepth(size_t depth) = 0;
+    virtual void FlushExpansions() = 0;
+    virtual void SaveState(BinaryWriter* out) const;
+    virtual void LoadState(BinaryReader* in);
+    virtual void SaveTables(std::vector<std::string>* tables) const;
+    virtual void JournalTables(std::vector<std::string>* tables, bool restart);
+    virtual void LoadTables(const std::vector<std::string>& tables,
+                            size_t* next);
+    virtual void CollectStats(StepStats* step) const;
+
+  protected:
+    void StartClock();
+    bool StopBeforeBatch();
+    StopReason EarlyStopReason() const;
+    void EvaluatePoints(const matrixd& points, int fidelity, vectord* values);
+    template <typename Alg>
+    static bool AdvancePhases(Alg* alg);
 
   protected:
     // Variables from the options structure
     ObjectiveFn fn_;
     int dim_;
     int max_observations_;
+    Domain domain_;
+    BatchObjectiveFn batch_fn_;
+    std::shared_ptr<Evaluator> evaluator_;
+    std::shared_ptr<EvaluationCache> cache_;
+    std::shared_ptr<TraceWriter> trace_;
+    double max_seconds_;
+    double target_value_;
+    int stall_observations_;
+    double stall_tolerance_;
+    std::vector<Fidelity> fidelities_;
 
     int num_observations_;  // Number of function observations so far
+    uint64_t num_steps_;    // Number of steps finished so far
+    uint64_t tell_nanoseconds_; // When the values being recorded came in,
+                                // for the trace
+    Stats stats_;           // Performance counters
+
+    StepPhase phase_;       // Where the current step is up to
+    size_t phase_depth_;    // Next depth to expand from in the expand phase
+    bool waiting_;          // Waiting to be told the values of ask_points_?
+    matrixd ask_points_;    // Points whose values are needed to go on
+    int ask_fidelity_;      // Which rung of fidelities_ they are for (-1 for
+                            // the objective itself)
+    vectord tell_values_;   // Scratch space for evaluating them in Step()
+    matrixd no_points_;     // What Ask() returns once the run is finished
+
+    bool clock_started_;    // Has the clock for max_seconds started?
+    Stats::clock::time_point start_time_; // When it started
+    Stats::clock::time_point last_batch_; // When the last batch was handed out
+    double max_batch_interval_; // Longest time between two batches
+    double stall_best_;     // Best value at the last improvement
+    int stall_start_;       // Observations made by the last improvement
+    std::shared_ptr<const std::atomic<bool>> stop_flag_; // Stops the run
+                                                         // once set
+    BatchHook batch_hook_;  // Checked before every batch
+    StopReason hook_reason_; // Why the hook stopped the run, if it did
+    bool journaling_;       // Are changes to the tables being journaled
+                            // for checkpoints?
 };
 
+/***********************************************************
+* AdvancePhases
+* Run the current step forward until it is finished or it
+* needs the values of ask_points_. Returns true if the step
+* was finished.
+* This is a template so that algorithms that know their own
+* type at compile time can run it with every call into them
+* bound statically.
+***********************************************************/
+template <typename Alg>
+bool OptIntf::AdvancePhases(Alg* alg)
+{
+  while (!alg->waiting_) {
+    switch (alg->phase_) {
+      case StepPhase::begin:
+        STATS(alg->stats_.BeginStep(alg->num_observations_));
+        alg->BeginStep();
+        alg->phase_depth_ = 0;
+        alg->phase_ = StepPhase::expand;
+        break;
+
+      case StepPhase::expand:
+        // For each 'depth level', expand the best node at that
+        // depth. The algorithm may need to look at a depth again (e.g.
+        // once its best node has a real value), in which case it
+        // returns false.
+        if (alg->phase_depth_ <= alg->CalculateMaxDepth()) {
+          if (alg->ExpandBestAtDepth(alg->phase_depth_)) {
+            alg->phase_depth_++;
+          }
+        } else {
+          alg->phase_ = StepPhase::flush;
+        }
+        break;
+
+      case StepPhase::flush:
+        // Carry out any expansions that were held back to be done together
+        alg->FlushExpansions();
+        alg->phase_ = StepPhase::end;
+        break;
+
+      case StepPhase::end:
+        alg->EndStep();
+        alg->num_steps_++;
+        STATS(alg->CollectStats(alg->stats_.current_step()));
+        STATS(alg->stats_.EndStep(alg->num_observations_));
+        alg->phase_ = StepPhase::begin;
+        return true;
+    }
+  }
+  return false;
+} /* AdvancePhases() */
+
 }
@@ -0,0 +1,89 @@
+/***********************************************************
+* philox.h
+* Philox4x32-10 counter-based random number generator
+* (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+* 3", SC 2011).
+* Instead of carrying a state from one number to the next,
+* it turns a 128 bit counter and a 64 bit key into 128
+* random bits through ten rounds of multiplications and
+* xors. Any number in the stream can be computed directly
+* from its counter, so threads can draw numbers in any order
+* and still get the same ones.
+* The generator is constexpr, so it is checked against the
+* known answers from the Random123 distribution at compile
+* time.
+***********************************************************/
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace cpplogo {
+
+using PhiloxCounter = std::array<uint32_t, 4>;
+using PhiloxKey = std::array<uint32_t, 2>;
+
+/***********************************************************
+* Philox4x32
+* Returns the random bits for 'counter' under 'key'.
+***********************************************************/
+constexpr PhiloxCounter Philox4x32(const PhiloxCounter& counter,
+                                   const PhiloxKey& key)
+{
+  const uint64_t c_m0 = 0xD2511F53;
+  const uint64_t c_m1 = 0xCD9E8D57;
+  const uint32_t c_w0 = 0x9E3779B9;
+  const uint32_t c_w1 = 0xBB67AE85;
+  uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  for (int round = 0; round < 10; round++) {
+    uint64_t p0 = c_m0 * c0;
+    uint64_t p1 = c_m1 * c2;
+    c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    c1 = static_cast<uint32_t>(p1);
+    c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c3 = static_cast<uint32_t>(p0);
+    k0 += c_w0;
+    k1 += c_w1;
+  }
+  return {{c0, c1, c2, c3}};
+} /* Philox4x32() */
+
+/***********************************************************
+* PhiloxEqual
+* Compares two blocks of bits in a constant expression.
+***********************************************************/
+constexpr bool PhiloxEqual(const PhiloxCounter& a, const PhiloxCounter& b)
+{
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+} /* PhiloxEqual() */
+
+// Known answers for philox4x32_10 from Random123's kat_vectors
+static_assert(PhiloxEqual(Philox4x32({{0, 0, 0, 0}}, {{0, 0}}),
+                          {{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}),
+              "Philox4x32 doesn't match the known answer for zeros");
+static_assert(PhiloxEqual(Philox4x32({{0xffffffff, 0xffffffff,
+                                       0xffffffff, 0xffffffff}},
+                                     {{0xffffffff, 0xffffffff}}),
+                          {{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}}),
+              "Philox4x32 doesn't match the known answer for ones");
+static_assert(PhiloxEqual(Philox4x32({{0x243f6a88, 0x85a308d3,
+                                       0x13198a2e, 0x03707344}},
+                                     {{0xa4093822, 0x299f31d0}}),
+                          {{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}),
+              "Philox4x32 doesn't match the known answer for pi");
+
+/***********************************************************
+* Philox64
+* 64 random bits for the counter (hi, lo) under 'key'.
+***********************************************************/
+inline uint64_t Philox64(uint64_t hi, uint64_t lo, uint64_t key)
+{
+  PhiloxCounter bits = Philox4x32(
+    {{static_cast<uint32_t>(lo), static_cast<uint32_t>(lo >> 32),
+      static_cast<uint32_t>(hi), static_cast<uint32_t>(hi >> 32)}},
+    {{static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32)}});
+  return (static_cast<uint64_t>(bits[1]) << 32) | bits[0];
+} /* Philox64() */
+
+}
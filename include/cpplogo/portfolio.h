@@ -0,0 +1,163 @@
+/***********************************************************
+* portfolio.h
+* Runs a portfolio of optimizers (e.g. the same algorithm
+* with many seeds, or several algorithms) side by side on a
+* pool of threads.
+* Every member only ever runs on one thread at a time, one
+* step per task. Each thread keeps its own queue of members
+* and takes steps from the front of it, putting the member
+* back at the end when the step is done; a thread whose
+* queue runs dry steals from the back of another's, and
+* sleeps until a member is queued (or the run is over) if
+* there is nothing to steal. The members can share a budget
+* of observations and a target value, so the whole
+* portfolio stops as soon as the budget is spent or any
+* member reaches the target. Both are checked by a hook
+* every member calls before each batch of points, which
+* charges the batch to the budget up front, and stopping
+* sets a flag every member checks at the same point, so
+* members stop in the middle of their current steps.
+* The members run concurrently, so each should have an
+* evaluator of its own (usually a SerialEvaluator), and
+* their objectives must be safe to call from several
+* threads at once. An EvaluationCache can be shared.
+***********************************************************/
+#pragma once
+#include "cpplogo/optintf.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cpplogo {
+
+class Portfolio {
+/***********************************************************
+* Options structure
+***********************************************************/
+  public:
+    struct Options {
+      Options() :
+        num_threads(0),
+        max_observations(std::numeric_limits<int64_t>::max()),
+        target_value(std::numeric_limits<double>::infinity()),
+        share_target(true)
+      {}
+      size_t num_threads;       // Threads to run the members on. 0 uses one
+                                // per hardware core.
+      int64_t max_observations; // Observations all the members may make
+                                // between them. Charged before every batch,
+                                // so only the last batch can go over it.
+      double target_value;      // A member is done once its best value
+                                // reaches this
+      bool share_target;        // Stop every member as soon as one of them
+                                // reaches the target
+    };
+
+/***********************************************************
+* Results
+***********************************************************/
+  public:
+    struct MemberResult {
+      MemberResult() :
+        num_observations(0), num_steps(0), best_value(0.0), seconds(0.0),
+        reached_target(false) {}
+      int num_observations; // Observations made by the member in the run
+      uint64_t num_steps;   // Steps taken by the member
+      double best_value;    // Best value it observed
+      double seconds;       // Wall time spent in its steps
+      bool reached_target;  // Did it reach the target value?
+    };
+
+    struct Result {
+      Result() :
+        num_observations(0), num_steps(0), num_steals(0),
+        num_reached_target(0), best_member(0),
+        best_value(-std::numeric_limits<double>::infinity()), seconds(0.0),
+        members() {}
+      int64_t num_observations;  // Observations made by all the members
+      uint64_t num_steps;        // Steps taken by all the members
+      uint64_t num_steals;       // Steps taken from another thread's queue
+      size_t num_reached_target; // Members that reached the target
+      size_t best_member;        // Index of the member with the best value
+      double best_value;         // Best value observed by any member
+      double seconds;            // Wall time of the whole run
+      std::vector<MemberResult> members;
+    };
+
+  public:
+    Portfolio(const Options& opt);
+    Portfolio(const Portfolio& rhs) = delete;
+    Portfolio& operator=(const Portfolio& rhs) = delete;
+    ~Portfolio() = default;
+
+  public:
+    size_t Add(std::shared_ptr<OptIntf> member);
+    const Result& Run();
+
+  public:
+    size_t num_members() const { return members_.size(); }
+    OptIntf* member(size_t i) const { return members_[i].get(); }
+    const Result& result() const { return result_; }
+
+  protected:
+    struct WorkQueue {
+      WorkQueue() : mutex(), members() {}
+      std::mutex mutex;
+      std::deque<size_t> members; // Members waiting for their next step
+    };
+
+    struct Charge {
+      Charge() : start_observations(0), charged(0) {}
+      int start_observations; // The member's observations when the run
+                              // started
+      int64_t charged;        // What the member has charged to the budget
+                              // in the run, including the batch in flight
+    };
+
+  protected:
+    void WorkerLoop(size_t worker);
+    bool NextMember(size_t worker, size_t* member);
+    bool StepMember(size_t member);
+    OptIntf::StopReason CheckBatch(size_t member, const OptIntf& alg,
+                                   int num_points);
+    int64_t SettleCharge(size_t member, const OptIntf& alg, int num_points);
+    void Requeue(size_t worker, size_t member);
+    void FinishMember();
+    void Stop();
+    void WakeIdle(bool all);
+
+  protected:
+    // Variables from the options structure
+    size_t num_threads_;
+    int64_t max_observations_;
+    double target_value_;
+    bool share_target_;
+
+    std::vector<std::shared_ptr<OptIntf>> members_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_; // One per thread
+    Result result_;
+
+    // State shared by the threads during a run
+    std::vector<Charge> charges_;           // One per member
+    std::atomic<int64_t> num_observations_; // Observations made so far, plus
+                                            // the batches in flight
+    std::atomic<size_t> num_active_;        // Members that aren't done
+    std::atomic<size_t> num_queued_;        // Members waiting in the queues
+    std::atomic<uint64_t> num_steals_;
+    std::shared_ptr<std::atomic<bool>> stop_; // Set to stop every member,
+                                              // which they all check
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_; // Signals idle threads that there may
+                                      // be work, or that the run is over
+    std::mutex error_mutex_;
+    std::exception_ptr error_;  // First exception thrown by a member
+};
+
+}
@@ -3,34 +3,106 @@
 * An extension to SOO in which the split dimension is 
 * chosen randomly according to the same rule rather than
 * deterministically.
+* The random choice for a node is drawn from a counter-based
+* generator keyed by the seed, with the node's cell as the
+* counter, so it is a pure function of the seed and the
+* node: the same run comes out whatever order (or however
+* many threads) the nodes are expanded in.
 ***********************************************************/
 #pragma once
 
 #include "cpplogo/soo.h"
+#include "cpplogo/philox.h"
+
+#include <limits>
+#include <stdexcept>
 
 namespace cpplogo {
 
-class RandomSOO : virtual public SOO {
+/***********************************************************
+* RandomFewestSplits
+* Split policy: find all the node's dimensions with maximum
+* size, i.e. the ones split the fewest times, and randomly
+* choose one.
+***********************************************************/
+class RandomFewestSplits {
   public:
-    struct Options : virtual public SOO::Options {
-      Options(ObjectiveFn fn, int dim, int max_observations, 
-              int num_children, int seed) :
-        SOO::Options(fn, dim, max_observations, num_children),
-        seed(seed)
-      {}
-      int seed; // Seed with which to initialize the RNG
+    struct Options {
+      using Args = std::tuple<int>;
+      Options(int seed) : seed(seed) {}
+      int seed; // Seed with which to key the RNG
     };
 
   public:
-    RandomSOO(const Options& opt);
-    virtual ~RandomSOO() = default;
+    RandomFewestSplits(const Options& opt, int dim) : seed_(opt.seed)
+      { (void)dim; }
+
+  public:
+    size_t Choose(const Node* node) const
+    {
+      // Count the dimensions that have been split the fewest times
+      const int dim = node->dim();
+      int min_splits = std::numeric_limits<int>::max();
+      size_t num_candidates = 0;
+      for (int d = 0; d < dim; d++) {
+        int splits = node->splits(d);
+        if (splits < min_splits) {
+          num_candidates = 0;
+          min_splits = splits;
+        }
+        if (splits == min_splits) {
+          num_candidates++;
+        }
+      }
+
+      // Choose one of them at random (if there are more than one), and go
+      // back for it rather than keeping a list of the candidates. Scaling
+      // the top 32 random bits by the number of candidates picks one
+      // without a division, and the product fits in 64 bits.
+      size_t choice = 0;
+      if (num_candidates > 1) {
+        uint64_t bits = Philox64(NodeCounter(node, dim, 0),
+                                 NodeCounter(node, dim, 1), seed_);
+        choice = static_cast<size_t>(((bits >> 32) * num_candidates) >> 32);
+      }
+      for (int d = 0; d < dim; d++) {
+        if (node->splits(d) == min_splits && choice-- == 0) {
+          return d;
+        }
+      }
+      return 0;
+    }
+    void Save(BinaryWriter* out) const
+    {
+      out->WriteUInt(static_cast<uint32_t>(seed_));
+    }
+    void Load(BinaryReader* in)
+    {
+      if (in->ReadUInt() != static_cast<uint32_t>(seed_)) {
+        throw std::runtime_error("Checkpoint seed doesn't match");
+      }
+    }
 
   protected:
-    size_t ChooseSplitDimension(const Node* node) const override;
+    // Hash the node's cell codes into one half of its counter. The two
+    // halves use different multipliers, so a collision needs both 64 bit
+    // hashes to collide at once.
+    static uint64_t NodeCounter(const Node* node, int dim, int half)
+    {
+      const uint64_t c_multipliers[2] = {0x9E3779B97F4A7C15ull,
+                                         0xC2B2AE3D27D4EB4Full};
+      uint64_t hash = half;
+      for (int d = 0; d < dim; d++) {
+        hash = (hash ^ node->code(d)) * c_multipliers[half];
+        hash ^= hash >> 29;
+      }
+      return hash;
+    }
 
   protected:
     int seed_;
-    mutable RandomEngine rng_;
 };
 
+using RandomSOO = BasicSOO<RandomFewestSplits, SingleDepths, ObserveCenters>;
+
 }
@@ -0,0 +1,57 @@
+/***********************************************************
+* serialize.h
+* Minimal helpers for reading and writing the compact binary
+* format used by checkpoints. Integers are written as
+* variable-length (LEB128) values and doubles as their raw
+* 8 bytes. Sizes that have to be read before the data they
+* describe is complete are written as fixed 8 byte values.
+***********************************************************/
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace cpplogo {
+
+class BinaryWriter {
+  public:
+    BinaryWriter(std::string* buffer);
+
+  public:
+    void WriteUInt(uint64_t value);
+    void WriteInt(int64_t value);
+    void WriteFixed(uint64_t value);
+    void WriteDouble(double value);
+    void WriteString(const std::string& value);
+    void WriteBytes(const std::string& bytes);
+    void WriteBytes(const char* bytes, size_t size);
+
+  public:
+    static size_t UIntSize(uint64_t value);
+
+  protected:
+    std::string* buffer_;
+};
+
+class BinaryReader {
+  public:
+    BinaryReader(const std::string* buffer);
+    BinaryReader(const std::string* buffer, size_t begin, size_t end);
+
+  public:
+    uint64_t ReadUInt();
+    int64_t ReadInt();
+    uint64_t ReadFixed();
+    double ReadDouble();
+    std::string ReadString();
+    const char* ReadBytes(size_t size);
+    bool AtEnd() const { return pos_ == end_; }
+    size_t position() const { return pos_; }
+    size_t remaining() const { return end_ - pos_; }
+
+  protected:
+    const std::string* buffer_;
+    size_t pos_;
+    size_t end_;  // Where the data being read stops
+};
+
+}
@@ -1,66 +1,685 @@
 /***********************************************************
 * soo.h
 * Implements SOO.
+* The algorithm is put together from three policies that are
+* fixed at compile time, so the calls into them from the
+* expansion loop can be inlined:
+*  - Split: which dimension a node is split along
+*  - DepthSet: which nodes compete with each other for
+*    expansion (single depths for SOO, sets of depths for
+*    LOGO)
+*  - Observe: how the new children of an expansion get
+*    their values (real ones from the objective, or fake
+*    ones as in BaMSOO)
+* SOOBase holds everything that doesn't depend on the
+* policies, and BasicSOO combines it with a set of policies.
+* SOO, LOGO, RandomSOO, RandomLOGO and BaMSOO are all
+* BasicSOOs with different policies.
+* With a fidelity ladder, new nodes that a rung's rule
+* covers get a low fidelity value instead of a real one.
+* Such a node is promoted (observed with the objective and
+* moved to its new place in its level) when it is the best
+* node of its depth set, before it can be expanded, so only
+* nodes the search is about to expand cost a full
+* evaluation.
 ***********************************************************/
 #pragma once
 #include "cpplogo/optintf.h"
 #include "cpplogo/node.h"
+#include "cpplogo/depthlevel.h"
+#include "cpplogo/spillstore.h"
+#include "cpplogo/logging.h"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
 
 namespace cpplogo {
 
-class SOO : public OptIntf {
+class SOOBase : public OptIntf {
 /***********************************************************
 * Options structure
 ***********************************************************/
   public:
     struct Options : public OptIntf::Options {
-      Options(ObjectiveFn fn, int dim, int max_observations, 
+      Options(ObjectiveFn fn, int dim, int max_observations,
               int num_children) :
-        OptIntf::Options(fn, dim, max_observations), num_children(num_children)
+        OptIntf::Options(fn, dim, max_observations), num_children(num_children),
+        batch_steps(false), max_space_bytes(0), spill_dir()
       {}
       int num_children; // Number of children each node splits into
+      bool batch_steps; // Choose all of a step's expansions up front, then
+                        // evaluate all of their children as one batch
+      size_t max_space_bytes; // Limit on the memory taken by the nodes in
+                              // the space (0 for no limit)
+      std::string spill_dir;  // Where to spill nodes that can't be pruned
+                              // to keep under the limit (empty for none)
     };
 
   public:
-    SOO(const Options& opt);
-    virtual ~SOO() = default;
+    SOOBase(const Options& opt, bool resuming = false);
+    SOOBase(const SOOBase& rhs) = delete;
+    SOOBase& operator=(const SOOBase& rhs) = delete;
+    virtual ~SOOBase() = default;
 
   public:
     int num_expansions() const { return num_expansions_; }
     int num_node_evals() const { return num_node_evals_; }
-    const std::vector<Node>& step_observed_nodes() const 
+    int num_low_fidelity_observations() const
+      { return num_low_fidelity_observations_; }
+    size_t num_pruned_nodes() const { return num_pruned_nodes_; }
+    size_t num_spilled_nodes() const;
+    const std::vector<Node>& step_observed_nodes() const
       { return step_observed_nodes_; }
 
   public:
-    const Node* BestNode() const;
+    const Node* BestNode() const
+      { return best_node_.has_value() ? &best_node_ : nullptr; }
+    vectord BestPoint() const;
+    double best_value() const override { return best_node_.value(); }
 
   protected:
+    void ReceiveValues(const vectord& values) override;
     void BeginStep() override;
-    void EndStep() override;
-    size_t CalculateMaxDepth() const override;
-    void ExpandBestAtDepth(size_t depth) override;
-
-  protected:
-    virtual const Node* BestNodeAtDepth(size_t depth) const;
-    virtual size_t ChooseSplitDimension(const Node* node) const;
-    virtual void ObserveNodes(std::vector<Node>* nodes);
-    virtual void ObserveNode(Node* node);
+    void SaveState(BinaryWriter* out) const override;
+    void LoadState(BinaryReader* in) override;
+    void SaveTables(std::vector<std::string>* tables) const override;
+    void JournalTables(std::vector<std::string>* tables, bool restart)
+      override;
+    void LoadTables(const std::vector<std::string>& tables, size_t* next)
+      override;
+    void CollectStats(StepStats* step) const override;
 
   protected:
-    Node* BestNodeAtDepth(size_t depth);
+    size_t BaseMaxDepth() const;
+    bool QueueExpansion(Node* node);
+    size_t LiveSpaceBytes() const;
+    bool NeedsPruning() const;
+    size_t MaxRemainingExpansions() const;
+    void PruneSpace(size_t max_expansions, size_t deepest_depth);
+    void SpillSpace(size_t max_bytes);
+    void SplitNode(const Node* node, size_t split_dim,
+                   std::vector<Node>* children);
+    void GrowSpace(size_t num_levels);
+    void MoveChildrenIntoSpace();
     void RemoveNode(Node* node);
-    std::vector<Node> ExpandNode(const Node* node) const;
+    bool IsExpandable(const Node* node) const;
+    void DropUnexpandable(Node* node);
+    void MapCenters(const std::vector<Node*>& nodes, matrixd* points) const;
+    int ChooseFidelity(const Node* node) const;
+    void RequestValues(const std::vector<Node*>& nodes);
+    void RequestNextFidelity();
+    void RequestFullValues(const std::vector<Node*>& nodes);
+    void PromoteNodes(const std::vector<Node*>& nodes);
+    void FinishPromotion();
+    void RecordLowFidelityObservation(Node* node, double value);
+    virtual void RecordObservation(Node* node, double value);
 
   protected:
     // Variables from the options structure
     int num_children_;
+    bool batch_steps_;
+    size_t max_space_bytes_;
 
     double vmax_;        // Best node value expanded in this step
     int num_expansions_; // Number of node expansions
     int num_node_evals_; // Number of node evaluations
-    std::vector<std::vector<Node>> space_;  // All levels of nodes
+    int num_low_fidelity_observations_; // Observations made with the
+                                        // fidelity ladder
+    size_t prune_bytes_;      // Space size at which to prune next
+    size_t num_pruned_nodes_; // Nodes dropped by pruning, or for being
+                              // split as finely as they can be, so far
+    NodeArena arena_;                       // Geometry of all the nodes
+    Node best_node_;                        // Copy of the best observation
+                                            // so far
+    std::unique_ptr<SpillStore> spill_;     // Where nodes are spilled to
+    std::vector<DepthLevel> space_;         // All levels of nodes
     std::vector<Node> step_observed_nodes_; // All nodes that were observed in
                                             // this step
+    std::vector<Node> children_;  // Scratch space for the children of
+                                  // expansions
+    std::vector<Node*> expansion_queue_; // Nodes waiting to be expanded
+    std::vector<int> expansion_depths_;  // Scratch space for their depths
+    std::vector<Node*> pending_;  // Scratch space for nodes to observe
+    std::vector<Node*> promotions_; // Scratch space for nodes to promote
+    std::vector<Node*> eval_nodes_; // Nodes waiting for their values
+    matrixd eval_points_; // Scratch space for their centers when there is
+    vectord eval_values_; // a cache, and for their values
+    std::vector<size_t> cache_misses_; // Which of them weren't in the cache
+    std::vector<NodeArena::Handle> pruned_; // Scratch space for pruning
+    std::vector<std::vector<Node*>> fidelity_nodes_; // Nodes to observe with
+                                                     // each rung of the
+                                                     // ladder, then with the
+                                                     // objective
+    size_t next_fidelity_; // Next entry of fidelity_nodes_ to ask for
+    bool promoting_;       // Is the last of fidelity_nodes_ a set of nodes
+                           // being promoted?
+};
+
+/***********************************************************
+* SOOOptions
+* Options structure of a BasicSOO. Takes the SOO options
+* followed by the arguments of each policy's options, in
+* policy order, e.g. (fn, dim, max_observations,
+* num_children, seed, w_schedule) for RandomLOGO. The
+* argument types come from the policies' Args tuples, so
+* braced lists can be passed for them.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe,
+          typename Args = decltype(std::tuple_cat(
+            std::declval<typename Split::Options::Args>(),
+            std::declval<typename DepthSet::Options::Args>(),
+            std::declval<typename Observe::Options::Args>()))>
+struct SOOOptions;
+
+template <typename Split, typename DepthSet, typename Observe,
+          typename... PolicyArgs>
+struct SOOOptions<Split, DepthSet, Observe, std::tuple<PolicyArgs...>> :
+  public SOOBase::Options, public Split::Options, public DepthSet::Options,
+  public Observe::Options
+{
+  using Args = std::tuple<PolicyArgs...>;
+
+  SOOOptions(ObjectiveFn fn, int dim, int max_observations,
+             int num_children, PolicyArgs... args) :
+    SOOOptions(std::forward_as_tuple(args...), fn, dim, max_observations,
+               num_children)
+  {}
+
+  private:
+    static constexpr size_t num_split_args =
+      std::tuple_size<typename Split::Options::Args>::value;
+    static constexpr size_t num_depth_set_args =
+      std::tuple_size<typename DepthSet::Options::Args>::value;
+    static constexpr size_t num_observe_args =
+      std::tuple_size<typename Observe::Options::Args>::value;
+
+    template <typename Tuple>
+    SOOOptions(const Tuple& args, ObjectiveFn fn, int dim,
+               int max_observations, int num_children) :
+      SOOBase::Options(fn, dim, max_observations, num_children),
+      Split::Options(Make<typename Split::Options, 0>(
+        args, std::make_index_sequence<num_split_args>())),
+      DepthSet::Options(Make<typename DepthSet::Options, num_split_args>(
+        args, std::make_index_sequence<num_depth_set_args>())),
+      Observe::Options(Make<typename Observe::Options,
+                            num_split_args + num_depth_set_args>(
+        args, std::make_index_sequence<num_observe_args>()))
+    {}
+
+    // Build a policy's options from its slice of the arguments
+    template <typename PolicyOptions, size_t Offset, typename Tuple,
+              size_t... I>
+    static PolicyOptions Make(const Tuple& args, std::index_sequence<I...>)
+      { return PolicyOptions(std::get<Offset+I>(args)...); }
+};
+
+/***********************************************************
+* BasicSOO
+* SOO with its split, depth set and observation policies.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+class BasicSOO : public SOOBase {
+  // Runs the steps with the hooks below
+  friend class OptIntf;
+
+  public:
+    using Options = SOOOptions<Split, DepthSet, Observe>;
+
+  public:
+    BasicSOO(const Options& opt) :
+      SOOBase(opt), split_(opt, dim_), depth_set_(opt, dim_),
+      observe_(opt, dim_)
+    {
+      // The root may have been observed before the policies existed
+      if (best_node_.has_value()) {
+        observe_.Record(best_node_);
+      }
+    }
+    // Resume from a checkpoint written by Save or a CheckpointWriter,
+    // without observing the root first
+    BasicSOO(const Options& opt, std::istream& checkpoint) :
+      SOOBase(opt, true), split_(opt, dim_), depth_set_(opt, dim_),
+      observe_(opt, dim_)
+    {
+      Load(checkpoint);
+    }
+    virtual ~BasicSOO() = default;
+
+  public:
+    const Observe& observe_policy() const { return observe_; }
+
+  protected:
+    bool Advance() final;
+    void BeginStep() final;
+    void EndStep() final;
+    size_t CalculateMaxDepth() const final;
+    bool ExpandBestAtDepth(size_t depth) final;
+    void FlushExpansions() final;
+    void SaveState(BinaryWriter* out) const final;
+    void LoadState(BinaryReader* in) final;
+    void SaveTables(std::vector<std::string>* tables) const final;
+    void JournalTables(std::vector<std::string>* tables, bool restart) final;
+    void LoadTables(const std::vector<std::string>& tables, size_t* next)
+      final;
+    void RecordObservation(Node* node, double value) final;
+
+  protected:
+    const Node* BestNodeAtDepth(size_t depth) const;
+    Node* BestNodeAtDepth(size_t depth);
+    void PromoteBestNodes(size_t depth);
+    size_t ChooseSplitDimension(const Node* node);
+    void ExpandNode(const Node* node, std::vector<Node>* children);
+    void ObserveNodes(std::vector<Node>* nodes);
+
+  protected:
+    Split split_;
+    DepthSet depth_set_;
+    Observe observe_;
+};
+
+/***********************************************************
+* Advance
+* Same as OptIntf::Advance, but with every call bound at
+* compile time.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+bool BasicSOO<Split, DepthSet, Observe>::Advance()
+{
+  return AdvancePhases(this);
+} /* Advance() */
+
+/***********************************************************
+* BeginStep
+* Prune the space if it has grown too big, then begin the
+* step as usual.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::BeginStep()
+{
+  if (NeedsPruning()) {
+    // Expansions can only be bounded if each of them uses up observations,
+    // and nodes can only be ranked for good if promotions can't change
+    // their values
+    size_t max_expansions = std::numeric_limits<size_t>::max();
+    size_t deepest_depth = std::numeric_limits<size_t>::max();
+    if (Observe::observes_all && fidelities_.empty()) {
+      max_expansions = MaxRemainingExpansions();
+      size_t max_depth = std::sqrt(static_cast<double>(num_expansions_)
+                                   + max_expansions);
+      deepest_depth = depth_set_.DeepestDepth(max_depth);
+    }
+    PruneSpace(max_expansions, deepest_depth);
+  }
+  SOOBase::BeginStep();
+} /* BeginStep() */
+
+/***********************************************************
+* EndStep
+* Called at the end of each optimization step.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::EndStep()
+{
+  LOG(trace) << "Ending step";
+  depth_set_.EndStep(step_observed_nodes_);
+} /* EndStep() */
+
+/***********************************************************
+* CalculateMaxDepth
+* Number of depth sets to expand from in this step.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+size_t BasicSOO<Split, DepthSet, Observe>::CalculateMaxDepth() const
+{
+  return depth_set_.MaxDepth(BaseMaxDepth());
+} /* CalculateMaxDepth() */
+
+/***********************************************************
+* ExpandBestAtDepth
+* Expand the node with the best value in the specified
+* depth set.
+* In batch mode the node is only queued here, and the
+* actual expansion happens in FlushExpansions at the end of
+* the step.
+* If the best node only has a low fidelity value, it is
+* promoted instead (along with the low fidelity best nodes
+* of the depth sets still to come) and false is returned,
+* so the depth set is looked at again once its value is
+* real. A best node that is already split as finely as its
+* cell codes allow is dropped, and false is returned too.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+bool BasicSOO<Split, DepthSet, Observe>::ExpandBestAtDepth(size_t depth)
+{
+  LOG(trace) << "Expanding depth " << depth;
+  Node* best_node = BestNodeAtDepth(depth);
+  if (!best_node) {
+    LOG(trace) << "Depth empty";
+    return true;
+  }
+  LOG(trace) << "Best node = " << *best_node;
+
+  if (!IsExpandable(best_node)) {
+    DropUnexpandable(best_node);
+    return false;
+  }
+  if (best_node->is_low_fidelity()) {
+    PromoteBestNodes(depth);
+    return false;
+  }
+  if (QueueExpansion(best_node) && !batch_steps_) {
+    FlushExpansions();
+  }
+  return true;
+} /* ExpandBestAtDepth() */
+
+/***********************************************************
+* FlushExpansions
+* Expand every queued node, observe all of their children
+* as a single batch, and move the children into the space.
+* If some of the children need values from the objective,
+* the move waits until they have been told.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::FlushExpansions()
+{
+  if (expansion_queue_.empty()) {
+    return;
+  }
+
+  children_.clear();
+  for (const Node* node : expansion_queue_) {
+    ExpandNode(node, &children_);
+  }
+  ObserveNodes(&children_);
+  if (!waiting_) {
+    MoveChildrenIntoSpace();
+  }
+} /* FlushExpansions() */
+
+/***********************************************************
+* SaveState
+* Write the base state followed by each policy's state.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::SaveState(BinaryWriter* out) const
+{
+  SOOBase::SaveState(out);
+  split_.Save(out);
+  depth_set_.Save(out);
+  observe_.Save(out);
+} /* SaveState() */
+
+/***********************************************************
+* LoadState
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::LoadState(BinaryReader* in)
+{
+  SOOBase::LoadState(in);
+  split_.Load(in);
+  depth_set_.Load(in);
+  observe_.Load(in);
+} /* LoadState() */
+
+/***********************************************************
+* SaveTables
+* The observation policy's tables come first, since the
+* number of levels grows.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::SaveTables(
+  std::vector<std::string>* tables) const
+{
+  observe_.SaveTables(tables);
+  SOOBase::SaveTables(tables);
+} /* SaveTables() */
+
+/***********************************************************
+* JournalTables
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::JournalTables(
+  std::vector<std::string>* tables, bool restart)
+{
+  observe_.JournalTables(tables, restart);
+  SOOBase::JournalTables(tables, restart);
+} /* JournalTables() */
+
+/***********************************************************
+* LoadTables
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::LoadTables(
+  const std::vector<std::string>& tables, size_t* next)
+{
+  observe_.LoadTables(tables, next);
+  SOOBase::LoadTables(tables, next);
+} /* LoadTables() */
+
+/***********************************************************
+* RecordObservation
+* Record a real observation, and let the observation policy
+* know about it.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::RecordObservation(Node* node,
+                                                           double value)
+{
+  SOOBase::RecordObservation(node, value);
+  observe_.Record(*node);
+} /* RecordObservation() */
+
+/***********************************************************
+* BestNodeAtDepth
+* Find the node with the best value in the specified depth
+* set. Returns a null pointer if the set has no nodes.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+const Node* BasicSOO<Split, DepthSet, Observe>::BestNodeAtDepth(
+  size_t depth) const
+{
+  return depth_set_.Best(space_, depth);
+} /* BestNodeAtDepth() */
+
+/***********************************************************
+* BestNodeAtDepth
+* Non-const version of the above.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+Node* BasicSOO<Split, DepthSet, Observe>::BestNodeAtDepth(size_t depth)
+{
+  const auto cthis = const_cast<const BasicSOO*>(this);
+  return const_cast<Node*>(cthis->BestNodeAtDepth(depth));
+} /* BestNodeAtDepth() */
+
+/***********************************************************
+* PromoteBestNodes
+* Promote the best node of every depth set from 'depth' on
+* that only has a low fidelity value, as a single batch.
+* Expansions at shallower depths can still add better low
+* fidelity children to a depth set further down; those are
+* promoted when the expand phase gets to them.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::PromoteBestNodes(size_t depth)
+{
+  promotions_.clear();
+  const size_t max_depth = CalculateMaxDepth();
+  for (size_t d = depth; d <= max_depth; d++) {
+    Node* node = BestNodeAtDepth(d);
+    if (node && node->is_low_fidelity()) {
+      promotions_.push_back(node);
+    }
+  }
+  PromoteNodes(promotions_);
+} /* PromoteBestNodes() */
+
+/***********************************************************
+* ChooseSplitDimension
+* Return which dimension the specified node should be split
+* along.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+size_t BasicSOO<Split, DepthSet, Observe>::ChooseSplitDimension(
+  const Node* node)
+{
+  size_t split_dim = split_.Choose(node);
+  LOG(trace) << "Splitting along " << split_dim;
+  return split_dim;
+} /* ChooseSplitDimension() */
+
+/***********************************************************
+* ExpandNode
+* Expand the specified node.
+* Appends the resultant child nodes to 'children'.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::ExpandNode(
+  const Node* node, std::vector<Node>* children)
+{
+  LOG(trace) << "Expanding " << *node;
+  SplitNode(node, ChooseSplitDimension(node), children);
+} /* ExpandNode() */
+
+/***********************************************************
+* ObserveNodes
+* Give a value to each node in a list of nodes that doesn't
+* have one yet, as decided by the observation policy.
+***********************************************************/
+template <typename Split, typename DepthSet, typename Observe>
+void BasicSOO<Split, DepthSet, Observe>::ObserveNodes(
+  std::vector<Node>* nodes)
+{
+  pending_.clear();
+  for (auto& node : *nodes) {
+    if (node.has_value()) {
+      LOG(trace) << "Already had: " << node;
+    } else {
+      pending_.push_back(&node);
+    }
+  }
+  if (pending_.empty()) {
+    return;
+  }
+  observe_.Observe(&pending_, best_value(),
+                   [this](const std::vector<Node*>& to_evaluate) {
+                     RequestValues(to_evaluate);
+                   });
+} /* ObserveNodes() */
+
+/***********************************************************
+* The policies used by SOO.
+* A policy has an Options structure with a constructor that
+* takes the arguments listed in its 'Args' tuple, a
+* constructor taking the algorithm's options and the
+* dimension, and Save/Load methods for its state.
+* Depth set policies also say how deep the space can be
+* expanded from given SOO's maximum depth (DeepestDepth),
+* and observation policies whether they give every node a
+* real value (observes_all). Pruning relies on both.
+* Observation policies can keep state that grows with the
+* run in checkpoint tables (see journal.h), through
+* SaveTables, JournalTables and LoadTables.
+***********************************************************/
+
+/***********************************************************
+* FewestSplits
+* Split policy: split along the first dimension that has
+* been split the fewest times, i.e. the first one with the
+* maximum size.
+***********************************************************/
+class FewestSplits {
+  public:
+    struct Options {
+      using Args = std::tuple<>;
+    };
+
+  public:
+    FewestSplits(const Options& opt, int dim) { (void)opt; (void)dim; }
+
+  public:
+    size_t Choose(const Node* node) const
+    {
+      const int dim = node->dim();
+      size_t min_dim = 0;
+      int min_splits = node->splits(0);
+      for (int d = 1; d < dim; d++) {
+        int splits = node->splits(d);
+        if (splits < min_splits) {
+          min_dim = d;
+          min_splits = splits;
+        }
+      }
+      return min_dim;
+    }
+    void Save(BinaryWriter* out) const { (void)out; }
+    void Load(BinaryReader* in) { (void)in; }
+};
+
+/***********************************************************
+* SingleDepths
+* Depth set policy: every depth of the space is its own
+* set, as in SOO.
+***********************************************************/
+class SingleDepths {
+  public:
+    struct Options {
+      using Args = std::tuple<>;
+    };
+
+  public:
+    SingleDepths(const Options& opt, int dim) { (void)opt; (void)dim; }
+
+  public:
+    size_t MaxDepth(size_t max_depth) const { return max_depth; }
+    size_t DeepestDepth(size_t max_depth) const { return max_depth; }
+    const Node* Best(const std::vector<DepthLevel>& space, size_t depth) const
+    {
+      // If the depth doesn't exist, it can't have a best node
+      if (depth >= space.size()) return nullptr;
+      return space[depth].Best();
+    }
+    void EndStep(const std::vector<Node>& step_observed_nodes)
+      { (void)step_observed_nodes; }
+    void Save(BinaryWriter* out) const { (void)out; }
+    void Load(BinaryReader* in) { (void)in; }
 };
 
+/***********************************************************
+* ObserveCenters
+* Observation policy: evaluate the objective at the center
+* of every new node.
+***********************************************************/
+class ObserveCenters {
+  public:
+    struct Options {
+      using Args = std::tuple<>;
+    };
+    static constexpr bool observes_all = true;
+
+  public:
+    ObserveCenters(const Options& opt, int dim) { (void)opt; (void)dim; }
+
+  public:
+    template <typename EvaluateFn>
+    void Observe(std::vector<Node*>* pending, double best_value,
+                 EvaluateFn evaluate)
+      { (void)best_value; evaluate(*pending); }
+    void Record(const Node& node) { (void)node; }
+    void Save(BinaryWriter* out) const { (void)out; }
+    void Load(BinaryReader* in) { (void)in; }
+    void SaveTables(std::vector<std::string>* tables) const { (void)tables; }
+    void JournalTables(std::vector<std::string>* tables, bool restart)
+      { (void)tables; (void)restart; }
+    void LoadTables(const std::vector<std::string>& tables, size_t* next)
+      { (void)tables; (void)next; }
+};
+
+using SOO = BasicSOO<FewestSplits, SingleDepths, ObserveCenters>;
+
 }
@@ -0,0 +1,64 @@
+/***********************************************************
+* spillstore.h
+* A scratch file that parts of the node space can be moved
+* out to when it grows beyond its memory limit. Data is
+* written as blocks that are read back whole. The file is
+* unlinked as soon as it is created, so it disappears with
+* the process.
+* Released blocks leave free ranges behind, which are
+* merged with their neighbours. New blocks go in the
+* smallest free range they fit in, and are only appended if
+* there is none, so the file stays about as big as the
+* blocks still in it. A free range at the end of the file
+* is cut off, and the file is truncated to nothing whenever
+* every block has been released.
+***********************************************************/
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace cpplogo {
+
+class SpillStore {
+  public:
+    struct Block {
+      uint64_t offset; // Where the block starts in the file
+      uint64_t size;   // ...and how many bytes it holds
+    };
+
+  public:
+    SpillStore(const std::string& dir);
+    SpillStore(const SpillStore& rhs) = delete;
+    SpillStore& operator=(const SpillStore& rhs) = delete;
+    ~SpillStore();
+
+  public:
+    Block Write(const std::string& data);
+    void Read(const Block& block, std::string* data) const;
+    void Release(const Block& block);
+    void Clear();
+
+  public:
+    uint64_t num_bytes() const { return live_bytes_; }
+    uint64_t num_file_bytes() const { return end_; }
+
+  protected:
+    uint64_t Allocate(uint64_t size);
+    void Free(uint64_t offset, uint64_t size);
+
+  protected:
+    int fd_;
+    uint64_t end_;        // End of the last block in the file
+    uint64_t live_bytes_; // Bytes in blocks that haven't been released
+    std::map<uint64_t, uint64_t> free_by_offset_; // Free ranges before end_,
+                                                  // offset to size
+    std::set<std::pair<uint64_t, uint64_t>> free_by_size_; // ...and the same
+                                                           // ranges as
+                                                           // (size, offset)
+};
+
+}
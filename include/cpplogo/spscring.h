@@ -0,0 +1,139 @@
+/***********************************************************
+* spscring.h
+* Lock-free ring buffer of fixed-size slots for exactly one
+* producer thread and one consumer thread.
+* The producer claims a slot, fills it in place and
+* publishes it; the consumer looks at every published slot
+* it hasn't released yet as (at most two) contiguous runs
+* of memory, so it can hand them straight to write().
+* Each side keeps a cached copy of the other side's index
+* and only reloads it when the ring looks full (or empty),
+* so in the common case a push is a couple of plain stores
+* and one release store.
+***********************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace cpplogo {
+
+class SPSCRing {
+  public:
+    SPSCRing(size_t slot_bytes, size_t num_slots);
+    SPSCRing(const SPSCRing& rhs) = delete;
+    SPSCRing& operator=(const SPSCRing& rhs) = delete;
+
+  public:
+    // Producer side
+    char* TryClaim();
+    void Publish();
+
+    // Consumer side
+    size_t Peek(const char** slots);
+    void Release(size_t num_slots);
+
+  public:
+    size_t slot_bytes() const { return slot_bytes_; }
+    size_t num_slots() const { return mask_+1; }
+
+  protected:
+    static constexpr size_t c_cache_line = 64;
+
+    size_t slot_bytes_;
+    size_t mask_;
+    std::vector<char> slots_;
+
+    // Written by the producer
+    std::atomic<size_t> head_;  // Slots published so far
+    size_t cached_tail_;        // Last value of tail_ it saw
+    char head_pad_[c_cache_line];
+
+    // Written by the consumer
+    std::atomic<size_t> tail_;  // Slots released so far
+    size_t cached_head_;        // Last value of head_ it saw
+    char tail_pad_[c_cache_line];
+};
+
+/***********************************************************
+* SPSCRing constructor
+* 'num_slots' is rounded up to a power of two.
+***********************************************************/
+inline SPSCRing::SPSCRing(size_t slot_bytes, size_t num_slots) :
+  slot_bytes_(slot_bytes), mask_(0), slots_(), head_(0), cached_tail_(0),
+  head_pad_(), tail_(0), cached_head_(0), tail_pad_()
+{
+  size_t size = 1;
+  while (size < num_slots) {
+    size *= 2;
+  }
+  mask_ = size-1;
+  slots_.resize(size * slot_bytes_);
+} /* SPSCRing() */
+
+/***********************************************************
+* TryClaim
+* Returns the next free slot for the producer to fill in,
+* or nullptr if the ring is full. Claiming again before
+* publishing returns the same slot.
+***********************************************************/
+inline char* SPSCRing::TryClaim()
+{
+  size_t head = head_.load(std::memory_order_relaxed);
+  if (head - cached_tail_ > mask_) {
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    if (head - cached_tail_ > mask_) {
+      return nullptr;
+    }
+  }
+  return &slots_[(head & mask_) * slot_bytes_];
+} /* TryClaim() */
+
+/***********************************************************
+* Publish
+* Hand the claimed slot over to the consumer.
+***********************************************************/
+inline void SPSCRing::Publish()
+{
+  head_.store(head_.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+} /* Publish() */
+
+/***********************************************************
+* Peek
+* Point 'slots' at the oldest published slot the consumer
+* hasn't released, and return how many published slots
+* follow it contiguously (0 if there are none). Whatever
+* wraps around the end of the ring is returned by the next
+* Peek after these are released.
+***********************************************************/
+inline size_t SPSCRing::Peek(const char** slots)
+{
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  if (cached_head_ == tail) {
+    cached_head_ = head_.load(std::memory_order_acquire);
+    if (cached_head_ == tail) {
+      return 0;
+    }
+  }
+  size_t first = tail & mask_;
+  size_t count = cached_head_ - tail;
+  if (first + count > mask_+1) {
+    count = mask_+1 - first;
+  }
+  *slots = &slots_[first * slot_bytes_];
+  return count;
+} /* Peek() */
+
+/***********************************************************
+* Release
+* Give the oldest 'num_slots' slots back to the producer.
+***********************************************************/
+inline void SPSCRing::Release(size_t num_slots)
+{
+  tail_.store(tail_.load(std::memory_order_relaxed) + num_slots,
+              std::memory_order_release);
+} /* Release() */
+
+}
@@ -0,0 +1,116 @@
+/***********************************************************
+* stats.h
+* Performance counters for the optimizers: how long each
+* step took and how much of that was spent in the objective,
+* the shape and size of the node space, and a histogram of
+* how long single evaluations take.
+* Counters are only collected when the library is built
+* with CPPLOGO_ENABLE_STATS. Otherwise the STATS() hooks in
+* the optimizers compile to nothing and every counter stays
+* at zero.
+***********************************************************/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#ifdef _CPPLOGO_ENABLE_STATS
+#define STATS(x) x
+#else
+#define STATS(x)
+#endif
+
+namespace cpplogo {
+
+/***********************************************************
+* LatencyHistogram
+* Counts latencies in power-of-two buckets of nanoseconds:
+* bucket b holds latencies in [2^b, 2^(b+1)) ns, with the
+* last bucket also holding anything longer. Safe to add to
+* from several threads at once.
+***********************************************************/
+class LatencyHistogram {
+  public:
+    static constexpr int num_buckets = 40;
+
+  public:
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram& rhs) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram& rhs) = delete;
+
+  public:
+    void Add(double seconds, uint64_t count = 1);
+    double Percentile(double p) const;
+
+  public:
+    uint64_t count(int bucket) const
+      { return counts_[bucket].load(std::memory_order_relaxed); }
+    uint64_t total_count() const;
+
+  protected:
+    std::atomic<uint64_t> counts_[num_buckets];
+};
+
+/***********************************************************
+* StepStats
+* Counters for a single optimization step.
+***********************************************************/
+struct StepStats {
+  StepStats() :
+    step(0), num_observations(0), seconds(0.0), fn_seconds(0.0),
+    live_nodes(0), space_bytes(0), nodes_per_depth() {}
+  double bookkeeping_seconds() const { return seconds - fn_seconds; }
+
+  uint64_t step;          // Which step this was, starting from 1
+  int num_observations;   // Observations made during the step
+  double seconds;         // Wall time of the whole step
+  double fn_seconds;      // Wall time spent evaluating the objective
+  size_t live_nodes;      // Nodes in the space at the end of the step
+  size_t space_bytes;     // Memory held by the node space
+  std::vector<size_t> nodes_per_depth; // Nodes at each depth of the space
+};
+
+class Stats {
+  public:
+    using clock = std::chrono::steady_clock;
+    static constexpr bool enabled =
+#ifdef _CPPLOGO_ENABLE_STATS
+      true;
+#else
+      false;
+#endif
+
+  public:
+    Stats();
+
+  public:
+    void BeginStep(int num_observations);
+    void AddFnTime(double seconds);
+    void EndStep(int num_observations);
+    void WriteJson(std::ostream& os) const;
+    static double SecondsSince(clock::time_point start);
+
+  public:
+    StepStats* current_step() { return &current_; }
+    const StepStats& last_step() const { return last_; }
+    uint64_t num_steps() const { return num_steps_; }
+    double total_seconds() const { return total_seconds_; }
+    double total_fn_seconds() const { return total_fn_seconds_; }
+    LatencyHistogram* eval_latency() { return &eval_latency_; }
+    const LatencyHistogram& eval_latency() const { return eval_latency_; }
+
+  protected:
+    StepStats current_;       // Step that is being recorded
+    StepStats last_;          // Last complete step
+    clock::time_point step_start_;
+    int step_start_observations_;
+    uint64_t num_steps_;
+    double total_seconds_;
+    double total_fn_seconds_;
+    LatencyHistogram eval_latency_; // Latency of single evaluations
+};
+
+}
@@ -0,0 +1,163 @@
+/***********************************************************
+* trace.h
+* Binary trace of every observation an optimizer makes: the
+* point, its value, the depth of its node, the step it was
+* observed in, when its value came in and which objective
+* of the fidelity ladder it came from.
+* Recording an observation only copies it into a lock-free
+* ring buffer; a background thread drains the ring into the
+* file, so the optimizer never waits on formatting or I/O
+* unless the ring fills up.
+* The file is a 32 byte header followed by fixed-size
+* records, all 8 byte aligned and in the machine's byte
+* order, so it can be memory-mapped and read in place (see
+* TraceReader). A record is a TraceRecord followed by the
+* 'dim' coordinates of the point as doubles.
+* A writer must only be recorded to from one thread at a
+* time, so every optimizer needs a writer of its own.
+***********************************************************/
+#pragma once
+#include "cpplogo/spscring.h"
+#include "cpplogo/stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace cpplogo {
+
+struct TraceRecord {
+  uint64_t nanoseconds; // When the value came in, since the trace was opened
+  uint64_t step;        // Step the observation was made in, starting from 0
+  uint32_t depth;       // Depth of the node that was observed
+  uint32_t fidelity;    // 0 for the objective, or 1 + the rung of the
+                        // fidelity ladder the value came from
+  double value;         // Observed value
+};
+
+/***********************************************************
+* TraceWriter
+***********************************************************/
+class TraceWriter {
+  public:
+    TraceWriter(const std::string& path, int dim, size_t ring_bytes = 1 << 22);
+    TraceWriter(const TraceWriter& rhs) = delete;
+    TraceWriter& operator=(const TraceWriter& rhs) = delete;
+    ~TraceWriter();
+
+  public:
+    uint64_t Now() const;
+    template <typename CenterFn>
+    void Record(uint64_t nanoseconds, uint64_t step, uint32_t depth,
+                double value, CenterFn center, uint32_t fidelity = 0);
+    void Close();
+
+  public:
+    int dim() const { return dim_; }
+    uint64_t num_records() const { return num_records_; }
+    uint64_t num_waits() const { return num_waits_; }
+    size_t ring_slots() const { return ring_.num_slots(); }
+
+  protected:
+    char* WaitForSlot();
+    void WriteLoop();
+    bool WriteSlots(const char* data, size_t num_slots);
+
+  protected:
+    int dim_;
+    size_t record_bytes_;
+    int fd_;
+    SPSCRing ring_;
+    Stats::clock::time_point start_;
+    uint64_t num_records_;  // Records made so far
+    uint64_t num_waits_;    // Times the ring was full when recording
+    std::atomic<bool> stop_;
+    std::atomic<bool> failed_; // Did the background thread fail to write?
+    std::thread writer_;
+};
+
+/***********************************************************
+* Now
+* Nanoseconds since the trace was opened. Reading the clock
+* costs about as much as the rest of a record, so callers
+* recording a batch of values that came in together should
+* read it once for the whole batch.
+***********************************************************/
+inline uint64_t TraceWriter::Now() const
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           Stats::clock::now() - start_).count();
+} /* Now() */
+
+/***********************************************************
+* Record
+* Add an observation of 'value' at the point whose
+* coordinates are given by center(d), made 'nanoseconds'
+* (from Now) into the trace.
+***********************************************************/
+template <typename CenterFn>
+void TraceWriter::Record(uint64_t nanoseconds, uint64_t step, uint32_t depth,
+                         double value, CenterFn center, uint32_t fidelity)
+{
+  char* slot = ring_.TryClaim();
+  if (slot == nullptr) {
+    slot = WaitForSlot();
+  }
+
+  TraceRecord record;
+  record.nanoseconds = nanoseconds;
+  record.step = step;
+  record.depth = depth;
+  record.fidelity = fidelity;
+  record.value = value;
+  std::memcpy(slot, &record, sizeof(record));
+  char* point = slot + sizeof(record);
+  for (int d = 0; d < dim_; d++) {
+    double x = center(d);
+    std::memcpy(point + d*sizeof(double), &x, sizeof(double));
+  }
+
+  ring_.Publish();
+  num_records_++;
+} /* Record() */
+
+/***********************************************************
+* TraceReader
+* Memory-maps a trace file for reading. A partial record at
+* the end (from a writer that didn't close) is ignored.
+***********************************************************/
+class TraceReader {
+  public:
+    TraceReader(const std::string& path);
+    TraceReader(const TraceReader& rhs) = delete;
+    TraceReader& operator=(const TraceReader& rhs) = delete;
+    ~TraceReader();
+
+  public:
+    int dim() const { return dim_; }
+    size_t size() const { return num_records_; }
+    uint64_t start_unix_nanoseconds() const { return start_unix_ns_; }
+    const TraceRecord& record(size_t i) const
+      { return *reinterpret_cast<const TraceRecord*>(RecordData(i)); }
+    const double* point(size_t i) const
+      { return reinterpret_cast<const double*>(RecordData(i)
+                                               + sizeof(TraceRecord)); }
+
+  protected:
+    const char* RecordData(size_t i) const
+      { return data_ + i*record_bytes_; }
+
+  protected:
+    int dim_;
+    size_t record_bytes_;
+    size_t num_records_;
+    uint64_t start_unix_ns_;
+    char* map_;
+    size_t map_size_;
+    const char* data_;  // Start of the first record
+};
+
+}
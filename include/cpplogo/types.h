@@ -21,6 +21,9 @@ using vectord = boost::numeric::ublas::vector<double>;
 using RandomEngine = std::mt19937;
 
 using ObjectiveFn = std::function<double(const vectord&)>;
+// Evaluates every row of the matrix as a point, and writes the value of row i
+// to element i of the (already correctly sized) result vector
+using BatchObjectiveFn = std::function<void(const matrixd&, vectord*)>;
   
 /*********************************************************************
 * END NAMESPACE
@@ -0,0 +1,111 @@
+#include "cpplogo/bamsoo.h"
+#include "cpplogo/logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cpplogo {
+
+/***********************************************************
+* ObserveUCB constructor
+***********************************************************/
+ObserveUCB::ObserveUCB(const Options& opt, int dim) :
+  eta_(opt.ucb_eta), max_points_(opt.gp_max_points),
+  max_fakes_(opt.max_fakes_per_observation),
+  gp_(dim, opt.gp_length_scale, opt.gp_signal_variance,
+      opt.gp_noise_variance),
+  num_observations_(0), num_fake_values_(0), center_(dim), to_evaluate_()
+{
+} /* ObserveUCB() */
+
+/***********************************************************
+* Screen
+* Decide which of the pending nodes need to be evaluated,
+* and give the rest of them fake values. Once the fake
+* values have used up their allowance, every node is
+* evaluated until there are enough real observations to
+* allow more.
+***********************************************************/
+void ObserveUCB::Screen(const std::vector<Node*>& pending, double best_value)
+{
+  to_evaluate_.clear();
+  if (gp_.size() == 0) {
+    to_evaluate_ = pending;
+    return;
+  }
+
+  const double width = ConfidenceWidth();
+  for (Node* node : pending) {
+    if (num_fake_values_ >= static_cast<long>(max_fakes_)*num_observations_) {
+      to_evaluate_.push_back(node);
+      continue;
+    }
+    for (size_t d = 0; d < center_.size(); d++) {
+      center_[d] = node->center(d);
+    }
+    double mean, variance;
+    gp_.Predict(center_.data(), &mean, &variance);
+    double sd = std::sqrt(variance);
+    if (mean + width*sd >= best_value) {
+      to_evaluate_.push_back(node);
+    } else {
+      node->SetFakeValue(mean - width*sd);
+      num_fake_values_++;
+      LOG(trace) << "Fake value: " << *node;
+    }
+  }
+} /* Screen() */
+
+/***********************************************************
+* Record
+* Condition the GP on a real observation, first making
+* room for it if the GP is full.
+***********************************************************/
+void ObserveUCB::Record(const Node& node)
+{
+  num_observations_++;
+  if (gp_.size() >= max_points_) {
+    gp_.Shrink(max_points_/2);
+    LOG(debug) << "Shrank the GP to " << gp_.size() << " observations";
+  }
+  for (size_t d = 0; d < center_.size(); d++) {
+    center_[d] = node.center(d);
+  }
+  if (!gp_.Add(center_.data(), node.value())) {
+    LOG(debug) << "Left " << node << " out of the GP";
+  }
+} /* Record() */
+
+/***********************************************************
+* ConfidenceWidth
+* Number of standard deviations the confidence bounds are
+* from the mean after N observations:
+* sqrt(2 log(pi^2 N^2 / (6 eta)))
+***********************************************************/
+double ObserveUCB::ConfidenceWidth() const
+{
+  double n = std::max(num_observations_, 1);
+  return std::sqrt(2.0 * std::log(M_PI*M_PI * n*n / (6.0*eta_)));
+} /* ConfidenceWidth() */
+
+/***********************************************************
+* Save
+***********************************************************/
+void ObserveUCB::Save(BinaryWriter* out) const
+{
+  out->WriteUInt(num_observations_);
+  out->WriteUInt(num_fake_values_);
+  gp_.Save(out);
+} /* Save() */
+
+/***********************************************************
+* Load
+***********************************************************/
+void ObserveUCB::Load(BinaryReader* in)
+{
+  num_observations_ = in->ReadUInt();
+  num_fake_values_ = in->ReadUInt();
+  gp_.Load(in);
+} /* Load() */
+
+}
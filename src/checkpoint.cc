@@ -0,0 +1,337 @@
+#include "cpplogo/checkpoint.h"
+
+#include "cpplogo/journal.h"
+#include "cpplogo/logging.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace cpplogo {
+
+namespace {
+
+const char c_checkpoint_magic[8] = {'C', 'P', 'L', 'G', 'C', 'K', 'P', 'T'};
+const uint64_t c_checkpoint_version = 7;
+
+}
+
+/***********************************************************
+* WriteCheckpointHeader
+* Write the start of a checkpoint file. Returns the number
+* of bytes written.
+***********************************************************/
+uint64_t WriteCheckpointHeader(std::ostream& os)
+{
+  std::string header(c_checkpoint_magic, sizeof(c_checkpoint_magic));
+  BinaryWriter out(&header);
+  out.WriteUInt(c_checkpoint_version);
+  os.write(header.data(), header.size());
+  return header.size();
+} /* WriteCheckpointHeader() */
+
+/***********************************************************
+* WriteCheckpointFrame
+* Write a frame: its size, then 'head' and 'tables' as
+* length-prefixed strings. The pieces are written as they
+* are rather than gathered into one buffer first. Returns
+* the number of bytes written.
+***********************************************************/
+uint64_t WriteCheckpointFrame(const std::string& head,
+                              const std::vector<std::string>& tables,
+                              std::ostream& os)
+{
+  uint64_t size = BinaryWriter::UIntSize(head.size()) + head.size()
+                  + BinaryWriter::UIntSize(tables.size());
+  for (const std::string& table : tables) {
+    size += BinaryWriter::UIntSize(table.size()) + table.size();
+  }
+
+  std::string prefix;
+  BinaryWriter out(&prefix);
+  out.WriteFixed(size);
+  out.WriteUInt(head.size());
+  os.write(prefix.data(), prefix.size());
+  os.write(head.data(), head.size());
+  prefix.clear();
+  out.WriteUInt(tables.size());
+  os.write(prefix.data(), prefix.size());
+  for (const std::string& table : tables) {
+    prefix.clear();
+    out.WriteUInt(table.size());
+    os.write(prefix.data(), prefix.size());
+    os.write(table.data(), table.size());
+  }
+  return sizeof(uint64_t) + size;
+} /* WriteCheckpointFrame() */
+
+/***********************************************************
+* ReadCheckpoint
+* Fold the frames of a checkpoint file together, giving the
+* head of the last frame and every table with all of its
+* changes applied.
+***********************************************************/
+void ReadCheckpoint(const std::string& data, std::string* head,
+                    std::vector<std::string>* tables)
+{
+  if (data.compare(0, sizeof(c_checkpoint_magic), c_checkpoint_magic,
+                   sizeof(c_checkpoint_magic)) != 0) {
+    throw std::runtime_error("Not a checkpoint");
+  }
+  BinaryReader in(&data);
+  in.ReadBytes(sizeof(c_checkpoint_magic));
+  if (in.ReadUInt() != c_checkpoint_version) {
+    throw std::runtime_error("Unsupported checkpoint version");
+  }
+
+  std::vector<std::vector<BinaryReader>> changes;
+  size_t head_begin = 0;
+  size_t head_size = 0;
+  bool any_frames = false;
+  while (in.remaining() >= sizeof(uint64_t)) {
+    uint64_t size = in.ReadFixed();
+    if (in.remaining() < size) {
+      break;  // Cut short while it was being appended
+    }
+    BinaryReader frame(&data, in.position(), in.position() + size);
+    in.ReadBytes(size);
+
+    head_size = frame.ReadUInt();
+    head_begin = frame.position();
+    frame.ReadBytes(head_size);
+    uint64_t num_tables = frame.ReadUInt();
+    if (changes.size() < num_tables) {
+      changes.resize(num_tables);
+    }
+    for (uint64_t t = 0; t < num_tables; t++) {
+      uint64_t table_size = frame.ReadUInt();
+      size_t begin = frame.position();
+      frame.ReadBytes(table_size);
+      changes[t].emplace_back(&data, begin, frame.position());
+    }
+    if (!frame.AtEnd()) {
+      throw std::runtime_error("Malformed checkpoint frame");
+    }
+    any_frames = true;
+  }
+  if (!any_frames) {
+    throw std::runtime_error("Checkpoint is empty");
+  }
+
+  head->assign(data, head_begin, head_size);
+  tables->resize(changes.size());
+  for (size_t t = 0; t < changes.size(); t++) {
+    Journal::Fold(&changes[t], &(*tables)[t]);
+  }
+} /* ReadCheckpoint() */
+
+/***********************************************************
+* CheckpointWriter constructor
+* Start the writer thread.
+***********************************************************/
+CheckpointWriter::CheckpointWriter(const std::string& path) :
+  path_(path), mutex_(), cv_(), pending_(), restart_(true), writing_(false),
+  shutdown_(false), num_written_(0), broken_(true), first_bytes_(0),
+  file_bytes_(0), thread_(&CheckpointWriter::WriterLoop, this)
+{
+} /* CheckpointWriter() */
+
+/***********************************************************
+* CheckpointWriter destructor
+* Finish writing the frames that were submitted, then stop
+* the writer thread.
+***********************************************************/
+CheckpointWriter::~CheckpointWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+} /* ~CheckpointWriter() */
+
+/***********************************************************
+* Submit
+* Gather what changed in the optimizer since the last
+* checkpoint and queue it to be written. The first
+* checkpoint, and the one after a write fails or the
+* optimizer is loaded, holds everything instead. A writer
+* should be the only one taking checkpoints of 'opt'.
+***********************************************************/
+void CheckpointWriter::Submit(OptIntf* opt)
+{
+  bool restart;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    restart = restart_;
+  }
+  Frame frame;
+  frame.full = opt->SaveChanges(&frame.head, &frame.tables, restart);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frame.full) {
+      // Everything waiting is out of date
+      restart_ = false;
+      pending_.clear();
+    }
+    pending_.push_back(std::move(frame));
+  }
+  cv_.notify_all();
+} /* Submit() */
+
+/***********************************************************
+* Wait
+* Block until every submitted checkpoint has been written.
+***********************************************************/
+void CheckpointWriter::Wait()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]{ return pending_.empty() && !writing_; });
+} /* Wait() */
+
+/***********************************************************
+* num_written
+***********************************************************/
+size_t CheckpointWriter::num_written() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_written_;
+} /* num_written() */
+
+/***********************************************************
+* WriterLoop
+* Main loop of the writer thread.
+***********************************************************/
+void CheckpointWriter::WriterLoop()
+{
+  std::vector<Frame> frames;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this]{ return shutdown_ || !pending_.empty(); });
+    if (pending_.empty()) {
+      return;
+    }
+
+    frames.clear();
+    frames.swap(pending_);
+    writing_ = true;
+    lock.unlock();
+
+    size_t num_written = WriteFrames(frames);
+
+    lock.lock();
+    writing_ = false;
+    num_written_ += num_written;
+    if (broken_) {
+      restart_ = true;
+    }
+    cv_.notify_all();
+  }
+} /* WriterLoop() */
+
+/***********************************************************
+* WriteFrames
+* Start a new file with each full frame and append the
+* others, then fold the file if the appended frames have
+* outgrown the first one. If a write fails, frames are
+* dropped until the next full one. Returns the number of
+* frames written.
+***********************************************************/
+size_t CheckpointWriter::WriteFrames(const std::vector<Frame>& frames)
+{
+  size_t num_written = 0;
+  std::ofstream file;
+  for (const Frame& frame : frames) {
+    if (frame.full) {
+      file.close();
+      broken_ = !WriteSnapshot(frame.head, frame.tables);
+    } else if (!broken_) {
+      if (!file.is_open()) {
+        file.open(path_, std::ios::binary | std::ios::app);
+      }
+      file_bytes_ += WriteCheckpointFrame(frame.head, frame.tables, file);
+      file.flush();
+      if (!file) {
+        LOG(error) << "Failed to append to checkpoint " << path_;
+        broken_ = true;
+      }
+    } else {
+      continue;
+    }
+    if (!broken_) {
+      num_written++;
+    }
+  }
+  file.close();
+
+  if (!broken_ && file_bytes_ - first_bytes_ > first_bytes_ && !Compact()) {
+    broken_ = true;
+  }
+  return num_written;
+} /* WriteFrames() */
+
+/***********************************************************
+* WriteSnapshot
+* Write a checkpoint with a single frame next to its final
+* location, then move it into place.
+***********************************************************/
+bool CheckpointWriter::WriteSnapshot(const std::string& head,
+                                     const std::vector<std::string>& tables)
+{
+  std::string tmp_path = path_ + ".tmp";
+  uint64_t size;
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    size = WriteCheckpointHeader(file);
+    size += WriteCheckpointFrame(head, tables, file);
+    file.flush();
+    if (!file) {
+      LOG(error) << "Failed to write checkpoint " << tmp_path;
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    LOG(error) << "Failed to move checkpoint into place at " << path_;
+    return false;
+  }
+  first_bytes_ = size;
+  file_bytes_ = size;
+  return true;
+} /* WriteSnapshot() */
+
+/***********************************************************
+* Compact
+* Fold the frames appended to the file into its first one.
+* If that fails, the file is left as it was, and the next
+* frame starts over with every record.
+***********************************************************/
+bool CheckpointWriter::Compact()
+{
+  std::string head;
+  std::vector<std::string> tables;
+  {
+    std::ifstream file(path_, std::ios::binary | std::ios::ate);
+    if (!file || static_cast<uint64_t>(file.tellg()) != file_bytes_) {
+      LOG(error) << "Checkpoint " << path_ << " changed while being written";
+      return false;
+    }
+    std::string data(file_bytes_, '\0');
+    file.seekg(0);
+    file.read(&data[0], data.size());
+    if (!file) {
+      LOG(error) << "Failed to read back checkpoint " << path_;
+      return false;
+    }
+    try {
+      ReadCheckpoint(data, &head, &tables);
+    } catch (const std::runtime_error& e) {
+      LOG(error) << "Failed to read back checkpoint " << path_ << ": "
+                 << e.what();
+      return false;
+    }
+  }
+  return WriteSnapshot(head, tables);
+} /* Compact() */
+
+}
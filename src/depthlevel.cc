@@ -0,0 +1,536 @@
+#include "cpplogo/depthlevel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <utility>
+
+namespace cpplogo {
+
+/***********************************************************
+* DepthLevel constructor
+***********************************************************/
+DepthLevel::DepthLevel() :
+  nodes_(), order_(), heap_pos_(), heap_(), next_order_(0), store_(nullptr),
+  spilled_(), num_spilled_(0), journal_()
+{
+} /* DepthLevel() */
+
+/***********************************************************
+* Insert
+* Add a copy of an observed node to this level.
+***********************************************************/
+void DepthLevel::Insert(const Node& node)
+{
+  if (journal_.active()) {
+    journal_.Put(next_order_, [&node](BinaryWriter* out) { node.Save(out); });
+  }
+  Push(node, next_order_++);
+} /* Insert() */
+
+/***********************************************************
+* Remove
+* Remove the specified node from this level. The last node
+* in the level is moved into its place, so any other
+* pointers into this level are invalidated.
+***********************************************************/
+void DepthLevel::Remove(const Node* node)
+{
+  size_t slot = node - nodes_.data();
+  assert(slot < nodes_.size());
+  if (journal_.active()) {
+    journal_.Erase(order_[slot]);
+  }
+
+  // Take the node out of the heap by replacing it with the last heap entry
+  size_t pos = heap_pos_[slot];
+  size_t last_pos = heap_.size()-1;
+  if (pos != last_pos) {
+    SwapHeap(pos, last_pos);
+    heap_.pop_back();
+    SiftUp(pos);
+    SiftDown(pos);
+  } else {
+    heap_.pop_back();
+  }
+
+  // Fill the hole in the node list with the last node
+  size_t last_slot = nodes_.size()-1;
+  if (slot != last_slot) {
+    nodes_[slot] = std::move(nodes_[last_slot]);
+    order_[slot] = order_[last_slot];
+    heap_pos_[slot] = heap_pos_[last_slot];
+    heap_[heap_pos_[slot]] = static_cast<uint32_t>(slot);
+  }
+  nodes_.pop_back();
+  order_.pop_back();
+  heap_pos_.pop_back();
+} /* Remove() */
+
+/***********************************************************
+* Update
+* Move the specified node to its place in the heap after
+* its value has changed. Call NeedsReload() afterwards, in
+* case the value went down.
+***********************************************************/
+void DepthLevel::Update(const Node* node)
+{
+  size_t slot = node - nodes_.data();
+  assert(slot < nodes_.size());
+  if (journal_.active()) {
+    journal_.Put(order_[slot], [node](BinaryWriter* out) { node->Save(out); });
+  }
+  SiftUp(heap_pos_[slot]);
+  SiftDown(heap_pos_[slot]);
+} /* Update() */
+
+/***********************************************************
+* Prune
+* Drop every node that has at least 'keep' better nodes in
+* this level, and append the handles of the ones that were
+* in memory to 'removed'. A block of spilled nodes is
+* dropped once 'keep' nodes in memory are better than its
+* best node.
+* Invalidates any pointers into this level.
+***********************************************************/
+void DepthLevel::Prune(size_t keep, std::vector<NodeArena::Handle>* removed)
+{
+  if (keep == 0) {
+    ReleaseSpilled();
+  }
+  if (nodes_.size() < keep) {
+    return;
+  }
+
+  std::vector<size_t> slots;
+  RankNodes(keep, &slots);
+  for (size_t i = keep; i < slots.size(); i++) {
+    removed->push_back(nodes_[slots[i]].handle());
+    if (journal_.active()) {
+      journal_.Erase(order_[slots[i]]);
+    }
+  }
+  if (keep > 0 && !spilled_.empty()) {
+    // The worst node that is kept is the keep-th best in memory
+    size_t worst = *std::max_element(slots.begin(), slots.begin()+keep,
+      [this](size_t a, size_t b) { return Better(a, b); });
+    for (size_t b = spilled_.size(); b-- > 0; ) {
+      if (Better(nodes_[worst].value(), order_[worst],
+                 spilled_[b].best_value, spilled_[b].best_order)) {
+        if (journal_.active()) {
+          JournalSpilled(spilled_[b]);
+        }
+        store_->Release(spilled_[b].block);
+        num_spilled_ -= spilled_[b].num_nodes;
+        spilled_.erase(spilled_.begin()+b);
+      }
+    }
+  }
+  KeepSlots(slots, keep);
+} /* Prune() */
+
+/***********************************************************
+* Spill
+* Keep only the 'keep' best nodes of this level in memory
+* (at least one), write the rest to 'store', and append
+* their handles to 'removed'.
+* Invalidates any pointers into this level.
+***********************************************************/
+void DepthLevel::Spill(size_t keep, SpillStore* store,
+                       std::vector<NodeArena::Handle>* removed)
+{
+  keep = std::max<size_t>(keep, 1);
+  if (nodes_.size() <= keep) {
+    return;
+  }
+  assert(store_ == nullptr || store_ == store);
+  store_ = store;
+
+  std::vector<size_t> slots;
+  RankNodes(keep, &slots);
+  std::sort(slots.begin()+keep, slots.end(),
+            [this](size_t a, size_t b) { return Better(a, b); });
+  // Blocks are written as tables, so a checkpoint can copy them as they are
+  Journal block;
+  std::string data;
+  for (size_t first = keep; first < slots.size();
+       first += c_spill_block_nodes) {
+    size_t last = std::min(first + c_spill_block_nodes, slots.size());
+    block.Start();
+    for (size_t i = first; i < last; i++) {
+      const Node& node = nodes_[slots[i]];
+      block.Put(order_[slots[i]],
+                [&node](BinaryWriter* out) { node.Save(out); });
+      removed->push_back(node.handle());
+    }
+    block.Take(&data);
+    size_t best = slots[first];
+    spilled_.push_back({store_->Write(data), last-first,
+                        nodes_[best].value(), order_[best]});
+    num_spilled_ += last-first;
+  }
+  KeepSlots(slots, keep);
+} /* Spill() */
+
+/***********************************************************
+* NeedsReload
+* Returns true if a spilled node could be better than every
+* node in memory, so spilled nodes have to be read back
+* before Best() can be trusted.
+***********************************************************/
+bool DepthLevel::NeedsReload() const
+{
+  if (spilled_.empty()) {
+    return false;
+  }
+  if (heap_.empty()) {
+    return true;
+  }
+  const SpilledBlock& spilled = spilled_[BestSpilledBlock()];
+  return Better(spilled.best_value, spilled.best_order,
+                nodes_[heap_[0]].value(), order_[heap_[0]]);
+} /* NeedsReload() */
+
+/***********************************************************
+* Reload
+* Read spilled blocks back, best first, until the best node
+* of the level is in memory. Their geometry goes into
+* 'arena'.
+***********************************************************/
+void DepthLevel::Reload(NodeArena* arena)
+{
+  std::vector<Node> nodes;
+  std::vector<uint64_t> order;
+  while (NeedsReload()) {
+    size_t b = BestSpilledBlock();
+    ReadBlock(spilled_[b], arena, &nodes, &order);
+    for (size_t i = 0; i < nodes.size(); i++) {
+      Push(nodes[i], order[i]);
+    }
+    store_->Release(spilled_[b].block);
+    num_spilled_ -= spilled_[b].num_nodes;
+    spilled_.erase(spilled_.begin()+b);
+  }
+} /* Reload() */
+
+/***********************************************************
+* Best
+* Returns a pointer to the node with the best value at this
+* level, or a null pointer if the level is empty.
+* Ties go to the node that was inserted first.
+***********************************************************/
+const Node* DepthLevel::Best() const
+{
+  if (heap_.empty()) return nullptr;
+  return &nodes_[heap_[0]];
+} /* Best() */
+
+/***********************************************************
+* Best
+* Non-const version of the above.
+***********************************************************/
+Node* DepthLevel::Best()
+{
+  if (heap_.empty()) return nullptr;
+  return &nodes_[heap_[0]];
+} /* Best() */
+
+/***********************************************************
+* Save
+* Write the insertion counter. The nodes themselves are
+* written as a table by SaveTable.
+***********************************************************/
+void DepthLevel::Save(BinaryWriter* out) const
+{
+  out->WriteUInt(next_order_);
+} /* Save() */
+
+/***********************************************************
+* Load
+* Empty this level and read back the insertion counter
+* written by Save. The journal is stopped.
+***********************************************************/
+void DepthLevel::Load(BinaryReader* in)
+{
+  journal_.Stop();
+  ReleaseSpilled();
+  nodes_.clear();
+  order_.clear();
+  heap_pos_.clear();
+  heap_.clear();
+  next_order_ = in->ReadUInt();
+} /* Load() */
+
+/***********************************************************
+* SaveTable
+* Write every node in this level keyed by its insertion
+* order, so ties are still broken the same way after a
+* reload. Spilled blocks are already tables, and are copied
+* exactly as they are in the spill store.
+***********************************************************/
+void DepthLevel::SaveTable(std::string* records) const
+{
+  Journal table;
+  table.Start();
+  for (size_t slot = 0; slot < nodes_.size(); slot++) {
+    const Node& node = nodes_[slot];
+    table.Put(order_[slot], [&node](BinaryWriter* out) { node.Save(out); });
+  }
+  table.Take(records);
+  std::string data;
+  for (const SpilledBlock& spilled : spilled_) {
+    store_->Read(spilled.block, &data);
+    records->append(data);
+  }
+} /* SaveTable() */
+
+/***********************************************************
+* LoadTable
+* Add the nodes of a table written by SaveTable to this
+* level. Their geometry goes into 'arena'. Every node ends
+* up in memory.
+***********************************************************/
+void DepthLevel::LoadTable(const std::string& records, NodeArena* arena)
+{
+  BinaryReader in(&records);
+  while (!in.AtEnd()) {
+    uint64_t order = Journal::ReadKey(&in);
+    Push(Node::Load(&in, arena), order);
+  }
+} /* LoadTable() */
+
+/***********************************************************
+* StartJournal
+* Write every node to 'records', as SaveTable does, and
+* start recording the changes made from here on.
+***********************************************************/
+void DepthLevel::StartJournal(std::string* records)
+{
+  journal_.Start();
+  SaveTable(records);
+} /* StartJournal() */
+
+/***********************************************************
+* TakeChanges
+* Move the changes made since the journal was started, or
+* since the last call, into 'changes'.
+***********************************************************/
+void DepthLevel::TakeChanges(std::string* changes)
+{
+  journal_.Take(changes);
+} /* TakeChanges() */
+
+/***********************************************************
+* num_bytes
+* Memory held by this level's buffers.
+***********************************************************/
+size_t DepthLevel::num_bytes() const
+{
+  return nodes_.capacity()*sizeof(Node) + order_.capacity()*sizeof(uint64_t)
+         + heap_pos_.capacity()*sizeof(uint32_t)
+         + heap_.capacity()*sizeof(uint32_t)
+         + spilled_.capacity()*sizeof(SpilledBlock);
+} /* num_bytes() */
+
+/***********************************************************
+* Push
+* Add a node with a given insertion order to the heap.
+***********************************************************/
+void DepthLevel::Push(const Node& node, uint64_t order)
+{
+  assert(node.has_value());
+  size_t slot = nodes_.size();
+  nodes_.push_back(node);
+  order_.push_back(order);
+  heap_pos_.push_back(static_cast<uint32_t>(heap_.size()));
+  heap_.push_back(static_cast<uint32_t>(slot));
+  SiftUp(heap_.size()-1);
+} /* Push() */
+
+/***********************************************************
+* Better
+* Returns true if the node in slot_a should be above the
+* node in slot_b in the heap.
+***********************************************************/
+bool DepthLevel::Better(size_t slot_a, size_t slot_b) const
+{
+  return Better(nodes_[slot_a].value(), order_[slot_a],
+                nodes_[slot_b].value(), order_[slot_b]);
+} /* Better() */
+
+/***********************************************************
+* Better
+* Same as above, for nodes that may not be in memory.
+***********************************************************/
+bool DepthLevel::Better(double value_a, uint64_t order_a,
+                        double value_b, uint64_t order_b)
+{
+  if (value_a != value_b) {
+    return value_a > value_b;
+  }
+  return order_a < order_b;
+} /* Better() */
+
+/***********************************************************
+* SwapHeap
+* Swap two heap entries and keep the position index in sync.
+***********************************************************/
+void DepthLevel::SwapHeap(size_t pos_a, size_t pos_b)
+{
+  std::swap(heap_[pos_a], heap_[pos_b]);
+  heap_pos_[heap_[pos_a]] = static_cast<uint32_t>(pos_a);
+  heap_pos_[heap_[pos_b]] = static_cast<uint32_t>(pos_b);
+} /* SwapHeap() */
+
+/***********************************************************
+* SiftUp
+* Move a heap entry up until its parent is better than it.
+***********************************************************/
+void DepthLevel::SiftUp(size_t pos)
+{
+  while (pos > 0) {
+    size_t parent = (pos-1)/2;
+    if (!Better(heap_[pos], heap_[parent])) break;
+    SwapHeap(pos, parent);
+    pos = parent;
+  }
+} /* SiftUp() */
+
+/***********************************************************
+* SiftDown
+* Move a heap entry down until it is better than both of
+* its children.
+***********************************************************/
+void DepthLevel::SiftDown(size_t pos)
+{
+  while (true) {
+    size_t best = pos;
+    size_t left = 2*pos+1;
+    size_t right = 2*pos+2;
+    if (left < heap_.size() && Better(heap_[left], heap_[best])) {
+      best = left;
+    }
+    if (right < heap_.size() && Better(heap_[right], heap_[best])) {
+      best = right;
+    }
+    if (best == pos) break;
+    SwapHeap(pos, best);
+    pos = best;
+  }
+} /* SiftDown() */
+
+/***********************************************************
+* RankNodes
+* Fill 'slots' with every slot in memory, the 'keep' best
+* ones first (in no particular order).
+***********************************************************/
+void DepthLevel::RankNodes(size_t keep, std::vector<size_t>* slots) const
+{
+  slots->resize(nodes_.size());
+  std::iota(slots->begin(), slots->end(), 0);
+  if (keep < slots->size()) {
+    std::nth_element(slots->begin(), slots->begin()+keep, slots->end(),
+                     [this](size_t a, size_t b) { return Better(a, b); });
+  }
+} /* RankNodes() */
+
+/***********************************************************
+* KeepSlots
+* Rebuild the level from the first 'keep' of 'slots', with
+* their insertion order unchanged, and give the memory of
+* the rest back.
+***********************************************************/
+void DepthLevel::KeepSlots(const std::vector<size_t>& slots, size_t keep)
+{
+  std::vector<Node> nodes;
+  std::vector<uint64_t> order;
+  nodes.reserve(keep);
+  order.reserve(keep);
+  for (size_t i = 0; i < keep; i++) {
+    nodes.push_back(nodes_[slots[i]]);
+    order.push_back(order_[slots[i]]);
+  }
+
+  nodes_.clear();
+  order_.clear();
+  heap_pos_.clear();
+  heap_.clear();
+  for (size_t i = 0; i < nodes.size(); i++) {
+    Push(nodes[i], order[i]);
+  }
+  nodes_.shrink_to_fit();
+  order_.shrink_to_fit();
+  heap_pos_.shrink_to_fit();
+  heap_.shrink_to_fit();
+} /* KeepSlots() */
+
+/***********************************************************
+* BestSpilledBlock
+* Index of the spilled block holding the best spilled node.
+***********************************************************/
+size_t DepthLevel::BestSpilledBlock() const
+{
+  size_t best = 0;
+  for (size_t b = 1; b < spilled_.size(); b++) {
+    if (Better(spilled_[b].best_value, spilled_[b].best_order,
+               spilled_[best].best_value, spilled_[best].best_order)) {
+      best = b;
+    }
+  }
+  return best;
+} /* BestSpilledBlock() */
+
+/***********************************************************
+* ReleaseSpilled
+* Forget every spilled node.
+***********************************************************/
+void DepthLevel::ReleaseSpilled()
+{
+  for (const SpilledBlock& spilled : spilled_) {
+    if (journal_.active()) {
+      JournalSpilled(spilled);
+    }
+    store_->Release(spilled.block);
+  }
+  spilled_.clear();
+  num_spilled_ = 0;
+} /* ReleaseSpilled() */
+
+/***********************************************************
+* JournalSpilled
+* Record that every node in a spilled block is being
+* dropped. Only their keys are needed, but they are only in
+* the block.
+***********************************************************/
+void DepthLevel::JournalSpilled(const SpilledBlock& spilled)
+{
+  std::string data;
+  store_->Read(spilled.block, &data);
+  BinaryReader in(&data);
+  while (!in.AtEnd()) {
+    journal_.Erase(in.ReadUInt());
+    in.ReadBytes(in.ReadUInt() - 1);
+  }
+} /* JournalSpilled() */
+
+/***********************************************************
+* ReadBlock
+* Read the nodes in a spilled block and their insertion
+* order, putting their geometry into 'arena'.
+***********************************************************/
+void DepthLevel::ReadBlock(const SpilledBlock& spilled, NodeArena* arena,
+                           std::vector<Node>* nodes,
+                           std::vector<uint64_t>* order) const
+{
+  std::string data;
+  store_->Read(spilled.block, &data);
+  BinaryReader in(&data);
+  nodes->clear();
+  order->clear();
+  for (size_t i = 0; i < spilled.num_nodes; i++) {
+    order->push_back(Journal::ReadKey(&in));
+    nodes->push_back(Node::Load(&in, arena));
+  }
+} /* ReadBlock() */
+
+}
@@ -0,0 +1,54 @@
+#include "cpplogo/domain.h"
+
+#include <stdexcept>
+
+namespace cpplogo {
+
+/***********************************************************
+* Domain constructor
+* 'bounds' has one entry per dimension, or is empty for the
+* unit hypercube.
+***********************************************************/
+Domain::Domain(int dim, const std::vector<Bound>& bounds) :
+  offsets_(dim, 0.0), scales_(dim, 1.0), log_scales_(dim, false)
+{
+  if (bounds.empty()) {
+    return;
+  }
+  if (bounds.size() != static_cast<size_t>(dim)) {
+    throw std::runtime_error("Need one bound per dimension");
+  }
+  for (int d = 0; d < dim; d++) {
+    const Bound& bound = bounds[d];
+    if (!(bound.lower < bound.upper)) {
+      throw std::runtime_error("Lower bound must be below the upper bound");
+    }
+    if (bound.log_scale) {
+      if (!(bound.lower > 0.0)) {
+        throw std::runtime_error("Log scaled bounds must be positive");
+      }
+      offsets_[d] = std::log(bound.lower);
+      scales_[d] = std::log(bound.upper) - offsets_[d];
+      log_scales_[d] = true;
+    } else {
+      offsets_[d] = bound.lower;
+      scales_[d] = bound.upper - bound.lower;
+    }
+  }
+} /* Domain() */
+
+/***********************************************************
+* Map
+* Map a whole point from the unit hypercube into the
+* domain.
+***********************************************************/
+vectord Domain::Map(const vectord& unit) const
+{
+  vectord point(unit.size());
+  for (size_t d = 0; d < unit.size(); d++) {
+    point(d) = Map(d, unit(d));
+  }
+  return point;
+} /* Map() */
+
+}
@@ -0,0 +1,378 @@
+#include "cpplogo/evalcache.h"
+
+#include "cpplogo/logging.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cpplogo {
+
+namespace {
+
+// Layout of the start of a cache file. It's followed by records made of
+// 'dim' coordinates and then the value, all stored as doubles.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dim;
+};
+
+const char c_magic[8] = {'C', 'P', 'L', 'G', 'M', 'E', 'M', 'O'};
+const uint32_t c_version = 1;
+
+// Slots of the file index a record may go in, starting at its hash
+const size_t c_probe_slots = 8;
+
+}
+
+/***********************************************************
+* EvaluationCache constructor
+* 'max_entries' bounds the in-memory table. If 'path' is
+* not empty, the file there is opened (or created) as the
+* persistent store, with an index of 'max_file_entries'
+* slots.
+***********************************************************/
+EvaluationCache::EvaluationCache(int dim, size_t max_entries,
+                                 const std::string& path,
+                                 size_t max_file_entries) :
+  mutex_(), dim_(dim), max_entries_(max_entries), points_(max_entries*dim),
+  values_(max_entries), hashes_(max_entries), next_entry_(0), table_(),
+  fd_(-1), map_(nullptr), map_size_(0), indexed_size_(sizeof(FileHeader)),
+  known_size_(sizeof(FileHeader)), file_index_(), file_index_mask_(0),
+  record_(dim+1),
+  num_hits_(0), num_misses_(0)
+{
+  table_.reserve(max_entries_);
+  if (!path.empty()) {
+    size_t num_slots = c_probe_slots;
+    while (num_slots < max_file_entries) {
+      num_slots *= 2;
+    }
+    file_index_.assign(num_slots, FileSlot{0, 0});
+    file_index_mask_ = num_slots-1;
+    OpenFile(path);
+  }
+} /* EvaluationCache() */
+
+/***********************************************************
+* EvaluationCache destructor
+***********************************************************/
+EvaluationCache::~EvaluationCache()
+{
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+} /* ~EvaluationCache() */
+
+/***********************************************************
+* Lookup
+* If a value has been stored for exactly this point, writes
+* it to 'value' and returns true.
+***********************************************************/
+bool EvaluationCache::Lookup(const double* point, double* value)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t hash = Hash(point);
+  if (LookupMemory(hash, point, value)) {
+    num_hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  if (fd_ >= 0 && FindInFile(hash, point, value)) {
+    // Keep it in memory so the next lookup doesn't need the file
+    InsertMemory(hash, point, *value);
+    num_hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  num_misses_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+} /* Lookup() */
+
+/***********************************************************
+* Insert
+* Store the value observed at a point.
+***********************************************************/
+void EvaluationCache::Insert(const double* point, double value)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t hash = Hash(point);
+  InsertMemory(hash, point, value);
+
+  if (fd_ >= 0) {
+    // Records are written with a single append, so processes sharing the
+    // file never interleave their records
+    std::copy(point, point+dim_, record_.begin());
+    record_[dim_] = value;
+    size_t num_bytes = record_.size()*sizeof(double);
+    if (write(fd_, record_.data(), num_bytes) != static_cast<ssize_t>(num_bytes)) {
+      LOG(error) << "Failed to append to evaluation cache: "
+                 << std::strerror(errno);
+      return;
+    }
+
+    // An append leaves our offset at the end of the record, wherever other
+    // processes' records put it, so it can be indexed without a rescan
+    off_t end = lseek(fd_, 0, SEEK_CUR);
+    if (end >= static_cast<off_t>(num_bytes)) {
+      IndexRecord(hash, end - num_bytes);
+      known_size_ += num_bytes;
+    }
+  }
+} /* Insert() */
+
+/***********************************************************
+* Hash
+* Hash the exact bit patterns of a point's coordinates.
+***********************************************************/
+uint64_t EvaluationCache::Hash(const double* point) const
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int d = 0; d < dim_; d++) {
+    uint64_t bits;
+    std::memcpy(&bits, &point[d], sizeof(bits));
+    hash = (hash ^ bits) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+} /* Hash() */
+
+/***********************************************************
+* LookupMemory
+* Look for the point in the in-memory table.
+***********************************************************/
+bool EvaluationCache::LookupMemory(uint64_t hash, const double* point,
+                                   double* value) const
+{
+  auto it = table_.find(hash);
+  if (it == table_.end()) {
+    return false;
+  }
+  size_t entry = it->second;
+  if (std::memcmp(&points_[entry*dim_], point, dim_*sizeof(double)) != 0) {
+    return false;
+  }
+  *value = values_[entry];
+  return true;
+} /* LookupMemory() */
+
+/***********************************************************
+* InsertMemory
+* Put a point into the in-memory table, replacing the
+* oldest entry once the table is full.
+***********************************************************/
+void EvaluationCache::InsertMemory(uint64_t hash, const double* point,
+                                   double value)
+{
+  if (max_entries_ == 0) {
+    return;
+  }
+
+  size_t entry = next_entry_;
+  next_entry_ = (next_entry_+1) % max_entries_;
+
+  // Forget whatever used to be in this entry
+  auto old = table_.find(hashes_[entry]);
+  if (old != table_.end() && old->second == entry) {
+    table_.erase(old);
+  }
+
+  std::memcpy(&points_[entry*dim_], point, dim_*sizeof(double));
+  values_[entry] = value;
+  hashes_[entry] = hash;
+  table_[hash] = entry;
+} /* InsertMemory() */
+
+/***********************************************************
+* Refresh
+* Pick up the records other processes have appended to the
+* persistent store since the last refresh. Lookups only see
+* records that were indexed, so call this before looking
+* up a batch of points; it is one fstat unless the file
+* grew past what is already indexed.
+***********************************************************/
+void EvaluationCache::Refresh()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ >= 0) {
+    MapFile();
+  }
+} /* Refresh() */
+
+/***********************************************************
+* FindInFile
+* Look for the point among the indexed records. Records we
+* appended after the file was last mapped are read with
+* pread instead.
+***********************************************************/
+bool EvaluationCache::FindInFile(uint64_t hash, const double* point,
+                                 double* value)
+{
+  const size_t record_size = (dim_+1)*sizeof(double);
+  for (size_t i = 0; i < c_probe_slots; i++) {
+    const FileSlot& slot = file_index_[(hash + i) & file_index_mask_];
+    if (slot.offset == 0) {
+      return false;
+    }
+    if (slot.hash != hash) {
+      continue;
+    }
+
+    const char* record;
+    if (slot.offset + record_size <= map_size_) {
+      record = map_ + slot.offset;
+    } else {
+      if (pread(fd_, record_.data(), record_size, slot.offset) !=
+          static_cast<ssize_t>(record_size)) {
+        continue;
+      }
+      record = reinterpret_cast<const char*>(record_.data());
+    }
+    // Another point with the same hash; a later slot may still hold this one
+    if (std::memcmp(record, point, dim_*sizeof(double)) != 0) {
+      continue;
+    }
+    std::memcpy(value, record + dim_*sizeof(double), sizeof(double));
+    return true;
+  }
+  return false;
+} /* FindInFile() */
+
+/***********************************************************
+* IndexRecord
+* Point the index at the record at 'offset'. A newer record
+* for the same hash replaces the old one; otherwise, if all
+* of its slots are taken, the oldest record is forgotten.
+***********************************************************/
+void EvaluationCache::IndexRecord(uint64_t hash, size_t offset)
+{
+  FileSlot* oldest = nullptr;
+  for (size_t i = 0; i < c_probe_slots; i++) {
+    FileSlot& slot = file_index_[(hash + i) & file_index_mask_];
+    if (slot.offset == 0 || slot.hash == hash) {
+      slot.hash = hash;
+      slot.offset = std::max<uint64_t>(slot.offset, offset);
+      return;
+    }
+    if (!oldest || slot.offset < oldest->offset) {
+      oldest = &slot;
+    }
+  }
+  oldest->hash = hash;
+  oldest->offset = offset;
+} /* IndexRecord() */
+
+/***********************************************************
+* OpenFile
+* Open or create the persistent store and index the records
+* that are already in it.
+* A record left half-written by a crash is cut off.
+***********************************************************/
+void EvaluationCache::OpenFile(const std::string& path)
+{
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Can't open evaluation cache " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  // Hold an exclusive lock while checking the header, so two processes
+  // creating the file at once don't both write one
+  flock(fd_, LOCK_EX);
+  struct stat st;
+  fstat(fd_, &st);
+  size_t file_size = st.st_size;
+  std::string error;
+  if (file_size == 0) {
+    FileHeader header;
+    std::memcpy(header.magic, c_magic, sizeof(c_magic));
+    header.version = c_version;
+    header.dim = dim_;
+    if (write(fd_, &header, sizeof(header)) != sizeof(header)) {
+      error = "can't write header";
+    }
+  } else {
+    FileHeader header;
+    if (pread(fd_, &header, sizeof(header), 0) != sizeof(header) ||
+        std::memcmp(header.magic, c_magic, sizeof(c_magic)) != 0 ||
+        header.version != c_version) {
+      error = "not an evaluation cache file";
+    } else if (header.dim != static_cast<uint32_t>(dim_)) {
+      error = "dimension doesn't match";
+    } else {
+      size_t record_size = (dim_+1)*sizeof(double);
+      size_t extra = (file_size - sizeof(header)) % record_size;
+      if (extra != 0 && ftruncate(fd_, file_size - extra) != 0) {
+        error = "can't remove partial record";
+      }
+    }
+  }
+  flock(fd_, LOCK_UN);
+  if (!error.empty()) {
+    close(fd_);
+    fd_ = -1;
+    throw std::runtime_error("Bad evaluation cache " + path + ": " + error);
+  }
+
+  MapFile();
+} /* OpenFile() */
+
+/***********************************************************
+* MapFile
+* Map all of the complete records in the file and index the
+* ones that haven't been indexed yet. Nothing needs doing
+* if the file only grew by our own appends, which were
+* indexed as they were made.
+***********************************************************/
+void EvaluationCache::MapFile()
+{
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    return;
+  }
+  size_t record_size = (dim_+1)*sizeof(double);
+  size_t file_size = st.st_size;
+  if (file_size < sizeof(FileHeader)) {
+    // Truncated under us; there are no records to map
+    return;
+  }
+  size_t num_records = (file_size - sizeof(FileHeader)) / record_size;
+  size_t usable_size = sizeof(FileHeader) + num_records*record_size;
+  if (usable_size <= known_size_) {
+    return;
+  }
+
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+  }
+  void* map = mmap(nullptr, usable_size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    LOG(error) << "Failed to map evaluation cache: " << std::strerror(errno);
+    map_ = nullptr;
+    map_size_ = 0;
+    std::fill(file_index_.begin(), file_index_.end(), FileSlot{0, 0});
+    indexed_size_ = sizeof(FileHeader);
+    known_size_ = indexed_size_;
+    return;
+  }
+  map_ = static_cast<char*>(map);
+  map_size_ = usable_size;
+
+  // Our own records in between are indexed again, which changes nothing
+  for (size_t offset = indexed_size_; offset < usable_size;
+       offset += record_size) {
+    const double* point = reinterpret_cast<const double*>(map_ + offset);
+    IndexRecord(Hash(point), offset);
+  }
+  indexed_size_ = usable_size;
+  known_size_ = usable_size;
+} /* MapFile() */
+
+}
@@ -0,0 +1,759 @@
+#include "cpplogo/evaluator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace cpplogo {
+
+/***********************************************************
+* SerialEvaluator::Evaluate
+* Evaluate every point, one after the other.
+***********************************************************/
+void SerialEvaluator::Evaluate(const ObjectiveFn& fn, const matrixd& points,
+                               vectord* values)
+{
+  values->resize(points.size1(), false);
+  vectord point(points.size2());
+  for (size_t i = 0; i < points.size1(); i++) {
+    for (size_t d = 0; d < points.size2(); d++) {
+      point(d) = points(i, d);
+    }
+    (*values)(i) = fn(point);
+  }
+} /* Evaluate() */
+
+/***********************************************************
+* ThreadPoolEvaluator constructor
+* Start the worker threads. They sleep until a batch
+* arrives.
+***********************************************************/
+ThreadPoolEvaluator::ThreadPoolEvaluator(size_t num_threads) :
+  workers_(), point_(), batch_mutex_(), mutex_(), work_cv_(), done_cv_(),
+  fn_(nullptr), points_(nullptr), values_(nullptr), next_point_(0),
+  batch_id_(0), open_slots_(0), busy_workers_(0), error_(), shutdown_(false)
+{
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  // The calling thread counts as one of the threads
+  for (size_t i = 1; i < num_threads; i++) {
+    workers_.emplace_back(&ThreadPoolEvaluator::WorkerLoop, this);
+  }
+} /* ThreadPoolEvaluator() */
+
+/***********************************************************
+* ThreadPoolEvaluator destructor
+* Wake up all the workers and wait for them to exit.
+***********************************************************/
+ThreadPoolEvaluator::~ThreadPoolEvaluator()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+} /* ~ThreadPoolEvaluator() */
+
+/***********************************************************
+* ThreadPoolEvaluator::Evaluate
+* Hand the batch to the workers, help evaluate it, and wait
+* until every point has a value.
+* If the objective throws, the first exception is rethrown
+* here once the whole batch has been processed.
+***********************************************************/
+void ThreadPoolEvaluator::Evaluate(const ObjectiveFn& fn,
+                                   const matrixd& points, vectord* values)
+{
+  std::lock_guard<std::mutex> batch_lock(batch_mutex_);
+  values->resize(points.size1(), false);
+  if (points.size1() == 0) {
+    return;
+  }
+
+  // The caller takes the first point, so there is no use waking more
+  // workers than there are points left
+  size_t num_helpers = std::min(workers_.size(), points.size1()-1);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fn_ = &fn;
+    points_ = &points;
+    values_ = values;
+    next_point_ = 0;
+    error_ = nullptr;
+    open_slots_ = num_helpers;
+    busy_workers_ = num_helpers;
+    batch_id_++;
+  }
+  for (size_t i = 0; i < num_helpers; i++) {
+    work_cv_.notify_one();
+  }
+
+  RunBatch(&point_);
+
+  // The batch state has to stay valid until every worker that joined is
+  // done with it. Workers that haven't joined yet are too late to help.
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    busy_workers_ -= open_slots_;
+    open_slots_ = 0;
+    done_cv_.wait(lock, [this]{ return busy_workers_ == 0; });
+    error = error_;
+    fn_ = nullptr;
+    points_ = nullptr;
+    values_ = nullptr;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+} /* Evaluate() */
+
+/***********************************************************
+* WorkerLoop
+* Main loop of each worker thread. Waits for a new batch
+* with room for another worker, helps evaluate it, then
+* reports back.
+***********************************************************/
+void ThreadPoolEvaluator::WorkerLoop()
+{
+  size_t last_batch = 0;
+  vectord point;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&]{
+        return shutdown_ || (batch_id_ != last_batch && open_slots_ > 0);
+      });
+      if (shutdown_) {
+        return;
+      }
+      last_batch = batch_id_;
+      open_slots_--;
+    }
+
+    RunBatch(&point);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      busy_workers_--;
+      if (busy_workers_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+} /* WorkerLoop() */
+
+/***********************************************************
+* RunBatch
+* Keep claiming unevaluated points from the current batch
+* until there are none left.
+* 'point' is the calling thread's own buffer for passing
+* points to the objective.
+***********************************************************/
+void ThreadPoolEvaluator::RunBatch(vectord* point)
+{
+  const size_t num_points = points_->size1();
+  if (point->size() != points_->size2()) {
+    point->resize(points_->size2(), false);
+  }
+  for (size_t i = next_point_++; i < num_points; i = next_point_++) {
+    for (size_t d = 0; d < point->size(); d++) {
+      (*point)(d) = (*points_)(i, d);
+    }
+    try {
+      (*values_)(i) = (*fn_)(*point);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+} /* RunBatch() */
+
+
+namespace {
+
+// How long workers (and the fork server) get to exit on their own when
+// they're stopped before they're killed
+const auto c_exit_grace = std::chrono::seconds(1);
+
+// What a worker sends back for each point
+struct WorkerReply {
+  double value;
+  uint64_t failed; // Non-zero if the objective threw
+};
+
+// What the fork server is asked to do
+struct ServerRequest {
+  enum Op : uint32_t { start, stop };
+  Op op;
+  uint32_t kill_worker; // Non-zero to kill the worker being stopped
+  int64_t pid;          // Worker to stop
+};
+
+// What the fork server sends back for a new worker, along with our end of
+// the worker's socket
+struct ServerReply {
+  int64_t pid; // Process ID of the new worker, or -1 if the fork failed
+};
+
+/***********************************************************
+* ReadAll
+* Read exactly 'size' bytes. Returns false if the other end
+* of the socket is gone.
+***********************************************************/
+bool ReadAll(int fd, void* data, size_t size)
+{
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = recv(fd, bytes, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    bytes += n;
+    size -= n;
+  }
+  return true;
+} /* ReadAll() */
+
+/***********************************************************
+* WriteAll
+* Write exactly 'size' bytes. Returns false if the other end
+* of the socket is gone.
+***********************************************************/
+bool WriteAll(int fd, const void* data, size_t size)
+{
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    bytes += n;
+    size -= n;
+  }
+  return true;
+} /* WriteAll() */
+
+/***********************************************************
+* SendWithFd
+* Write a message along with a file descriptor for the
+* other end to receive. Returns false if it is gone.
+***********************************************************/
+bool SendWithFd(int fd, const void* data, size_t size, int passed_fd)
+{
+  iovec iov = {const_cast<void*>(data), size};
+  char control[CMSG_SPACE(sizeof(int))];
+  std::memset(control, 0, sizeof(control));
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (passed_fd >= 0) {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+  }
+  ssize_t n;
+  do {
+    n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  return n == static_cast<ssize_t>(size);
+} /* SendWithFd() */
+
+/***********************************************************
+* ReceiveWithFd
+* Read a message sent by SendWithFd. '*passed_fd' is -1 if
+* it came without a file descriptor. Returns false if the
+* other end is gone.
+***********************************************************/
+bool ReceiveWithFd(int fd, void* data, size_t size, int* passed_fd)
+{
+  iovec iov = {data, size};
+  char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n;
+  do {
+    n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  *passed_fd = -1;
+  cmsghdr* cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    std::memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  // The messages are small enough to always arrive in one piece
+  return n == static_cast<ssize_t>(size);
+} /* ReceiveWithFd() */
+
+/***********************************************************
+* CloseOtherFds
+* Close every file descriptor except the standard streams
+* and 'keep'. A forked process inherits all of its parent's
+* descriptors, including the sockets of other pools and
+* workers, and a socket isn't closed until every process
+* holding it is gone; nothing is exec'ed, so close-on-exec
+* doesn't help. Falls back to walking /proc/self/fd (without
+* allocating) on kernels without close_range.
+***********************************************************/
+void CloseOtherFds(int keep)
+{
+  const int first = STDERR_FILENO + 1;
+#ifdef SYS_close_range
+  if ((keep <= first || syscall(SYS_close_range, first, keep - 1, 0) == 0) &&
+      syscall(SYS_close_range, std::max(keep + 1, first), ~0u, 0) == 0) {
+    return;
+  }
+#endif
+  int dir = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir < 0) {
+    for (int fd = first; fd < sysconf(_SC_OPEN_MAX); fd++) {
+      if (fd != keep) {
+        close(fd);
+      }
+    }
+    return;
+  }
+  char buffer[4096];
+  long n;
+  while ((n = syscall(SYS_getdents64, dir, buffer, sizeof(buffer))) > 0) {
+    for (long offset = 0; offset < n;) {
+      // Each entry is a 64-bit inode and offset, a 16-bit length and an
+      // 8-bit type, then the name
+      unsigned short length;
+      std::memcpy(&length, buffer + offset + 16, sizeof(length));
+      const char* name = buffer + offset + 19;
+      offset += length;
+      if (*name < '0' || *name > '9') {
+        continue;
+      }
+      int fd = std::atoi(name);
+      if (fd >= first && fd != keep && fd != dir) {
+        close(fd);
+      }
+    }
+  }
+  close(dir);
+} /* CloseOtherFds() */
+
+/***********************************************************
+* Reap
+* Wait for child processes to exit, and kill the ones that
+* are still running once 'grace' has passed. Empties 'pids'.
+***********************************************************/
+void Reap(std::vector<pid_t>* pids, std::chrono::milliseconds grace)
+{
+  const auto deadline = std::chrono::steady_clock::now() + grace;
+  while (true) {
+    for (size_t i = 0; i < pids->size();) {
+      pid_t result = waitpid((*pids)[i], nullptr, WNOHANG);
+      if (result == 0 || (result < 0 && errno == EINTR)) {
+        i++;
+      } else {
+        (*pids)[i] = pids->back();
+        pids->pop_back();
+      }
+    }
+    if (pids->empty() || std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+    poll(nullptr, 0, 10);
+  }
+  for (pid_t pid : *pids) {
+    kill(pid, SIGKILL);
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+  }
+  pids->clear();
+} /* Reap() */
+
+}
+
+/***********************************************************
+* ProcessPoolEvaluator constructor
+* Fork the fork server, and have it fork all of the
+* workers.
+***********************************************************/
+ProcessPoolEvaluator::ProcessPoolEvaluator(ObjectiveFn fn,
+                                           size_t num_workers,
+                                           size_t max_evaluations_per_worker,
+                                           int max_attempts) :
+  fn_(fn), server_pid_(-1), server_fd_(-1), batch_mutex_(),
+  max_evaluations_per_worker_(max_evaluations_per_worker),
+  max_attempts_(max_attempts), workers_(), num_restarts_(0), next_point_(0),
+  retry_(), attempts_(), request_()
+{
+  if (num_workers == 0) {
+    num_workers = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    throw std::runtime_error("Failed to create a socket for the fork server");
+  }
+  server_pid_ = fork();
+  if (server_pid_ < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    throw std::runtime_error("Failed to fork the fork server");
+  }
+  if (server_pid_ == 0) {
+    CloseOtherFds(fds[1]);
+    ServerMain(fn_, fds[1]);
+  }
+  close(fds[1]);
+  server_fd_ = fds[0];
+
+  workers_.resize(num_workers);
+  try {
+    for (auto& worker : workers_) {
+      StartWorker(&worker);
+    }
+  } catch (...) {
+    Shutdown();
+    throw;
+  }
+} /* ProcessPoolEvaluator() */
+
+/***********************************************************
+* ProcessPoolEvaluator destructor
+***********************************************************/
+ProcessPoolEvaluator::~ProcessPoolEvaluator()
+{
+  Shutdown();
+} /* ~ProcessPoolEvaluator() */
+
+/***********************************************************
+* Shutdown
+* Close the sockets, which tells the workers to exit, and
+* have the fork server reap them, killing the ones that
+* don't exit in time. The server exits once its own socket
+* is closed, and is killed if it doesn't.
+***********************************************************/
+void ProcessPoolEvaluator::Shutdown()
+{
+  for (auto& worker : workers_) {
+    StopWorker(&worker, false);
+  }
+  if (server_pid_ > 0) {
+    close(server_fd_);
+    std::vector<pid_t> server = {server_pid_};
+    Reap(&server, 2*c_exit_grace);
+    server_pid_ = -1;
+    server_fd_ = -1;
+  }
+} /* Shutdown() */
+
+/***********************************************************
+* ProcessPoolEvaluator::Evaluate
+* Keep every worker busy with one point at a time until
+* every point has a value.
+* If the objective throws in a worker, the rest of the
+* batch is still evaluated and an exception is thrown here
+* afterwards. If the same point takes down 'max_attempts'
+* workers, the batch is abandoned.
+***********************************************************/
+void ProcessPoolEvaluator::Evaluate(const ObjectiveFn& fn,
+                                    const matrixd& points, vectord* values)
+{
+  (void)fn;
+  std::lock_guard<std::mutex> batch_lock(batch_mutex_);
+  const size_t num_points = points.size1();
+  values->resize(num_points, false);
+  if (num_points == 0) {
+    return;
+  }
+
+  next_point_ = 0;
+  retry_.clear();
+  attempts_.assign(num_points, 0);
+  for (auto& worker : workers_) {
+    Dispatch(&worker, points);
+  }
+
+  std::vector<pollfd> fds;
+  std::vector<Worker*> polled;
+  size_t num_done = 0;
+  bool failed = false;
+  while (num_done < num_points) {
+    fds.clear();
+    polled.clear();
+    for (auto& worker : workers_) {
+      if (worker.point >= 0) {
+        fds.push_back({worker.fd, POLLIN, 0});
+        polled.push_back(&worker);
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Abort();
+      throw std::runtime_error("Failed to wait for worker processes");
+    }
+
+    for (size_t i = 0; i < fds.size(); i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      Worker* worker = polled[i];
+      size_t point = worker->point;
+      WorkerReply reply;
+      if (ReadAll(worker->fd, &reply, sizeof(reply))) {
+        (*values)(point) = reply.value;
+        failed = failed || reply.failed;
+        num_done++;
+        worker->point = -1;
+        worker->num_evaluations++;
+        // Replace workers that have done their share, in case they leak
+        if (max_evaluations_per_worker_ != 0 && 
+            worker->num_evaluations >= max_evaluations_per_worker_) {
+          StopWorker(worker, false);
+          StartWorker(worker);
+        }
+      } else {
+        // The worker died. Send its point out again, unless it has taken
+        // down too many workers already.
+        StopWorker(worker, true);
+        StartWorker(worker);
+        num_restarts_++;
+        if (attempts_[point] >= max_attempts_) {
+          Abort();
+          throw std::runtime_error("Objective crashed a worker process on "
+                                   "every attempt");
+        }
+        retry_.push_back(point);
+      }
+      Dispatch(worker, points);
+    }
+  }
+
+  if (failed) {
+    throw std::runtime_error("Objective threw in a worker process");
+  }
+} /* Evaluate() */
+
+/***********************************************************
+* StartWorker
+* Have the fork server fork a new worker process, and take
+* our end of the socket connecting it to us.
+***********************************************************/
+void ProcessPoolEvaluator::StartWorker(Worker* worker)
+{
+  ServerRequest request = {ServerRequest::start, 0, -1};
+  ServerReply reply = {-1};
+  int fd = -1;
+  if (!WriteAll(server_fd_, &request, sizeof(request)) ||
+      !ReceiveWithFd(server_fd_, &reply, sizeof(reply), &fd) ||
+      reply.pid < 0 || fd < 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::runtime_error("Failed to fork a worker process");
+  }
+  worker->pid = static_cast<pid_t>(reply.pid);
+  worker->fd = fd;
+  worker->num_evaluations = 0;
+  worker->point = -1;
+} /* StartWorker() */
+
+/***********************************************************
+* StopWorker
+* Close the socket to a worker and have the fork server
+* wait for it to exit. Workers that are in the middle of a
+* point are killed straight away, and the others if they
+* haven't exited after a grace period. Only the server reaps workers, so their
+* process IDs can't be reused before it has killed them.
+***********************************************************/
+void ProcessPoolEvaluator::StopWorker(Worker* worker, bool kill_worker)
+{
+  if (worker->pid < 0) {
+    return;
+  }
+  close(worker->fd);
+  ServerRequest request = {ServerRequest::stop, kill_worker, worker->pid};
+  WriteAll(server_fd_, &request, sizeof(request));
+  worker->pid = -1;
+  worker->fd = -1;
+  worker->point = -1;
+} /* StopWorker() */
+
+/***********************************************************
+* Dispatch
+* Send an idle worker the next point to evaluate, if there
+* is one. Points that have to be sent again go first.
+***********************************************************/
+void ProcessPoolEvaluator::Dispatch(Worker* worker, const matrixd& points)
+{
+  while (worker->point < 0) {
+    size_t point;
+    if (!retry_.empty()) {
+      point = retry_.front();
+      retry_.pop_front();
+    } else if (next_point_ < points.size1()) {
+      point = next_point_++;
+    } else {
+      return;
+    }
+
+    // Each request is the dimension followed by the coordinates
+    const uint64_t dim = points.size2();
+    request_.resize(sizeof(dim) + dim*sizeof(double));
+    std::memcpy(request_.data(), &dim, sizeof(dim));
+    for (size_t d = 0; d < dim; d++) {
+      double x = points(point, d);
+      std::memcpy(request_.data() + sizeof(dim) + d*sizeof(double), &x,
+                  sizeof(x));
+    }
+    attempts_[point]++;
+    if (WriteAll(worker->fd, request_.data(), request_.size())) {
+      worker->point = point;
+    } else {
+      // The worker died while it was idle, which doesn't count against
+      // the point
+      attempts_[point]--;
+      retry_.push_front(point);
+      StopWorker(worker, true);
+      StartWorker(worker);
+      num_restarts_++;
+    }
+  }
+} /* Dispatch() */
+
+/***********************************************************
+* Abort
+* Replace every worker that is still busy with a point, so
+* the next batch starts from a clean slate.
+***********************************************************/
+void ProcessPoolEvaluator::Abort()
+{
+  for (auto& worker : workers_) {
+    if (worker.point >= 0) {
+      StopWorker(&worker, true);
+      StartWorker(&worker);
+    }
+  }
+  retry_.clear();
+} /* Abort() */
+
+/***********************************************************
+* ServerMain
+* Main loop of the fork server: fork a worker for each start
+* request and send back our client's end of its socket, and
+* reap the workers it is asked to stop, until its socket is
+* closed. Reaps any workers left before exiting.
+***********************************************************/
+void ProcessPoolEvaluator::ServerMain(const ObjectiveFn& fn, int fd)
+{
+  std::vector<pid_t> workers;
+  std::vector<pid_t> stopping;
+  ServerRequest request;
+  while (ReadAll(fd, &request, sizeof(request))) {
+    if (request.op == ServerRequest::stop) {
+      pid_t pid = static_cast<pid_t>(request.pid);
+      auto it = std::find(workers.begin(), workers.end(), pid);
+      if (it == workers.end()) {
+        continue;
+      }
+      workers.erase(it);
+      if (request.kill_worker) {
+        kill(pid, SIGKILL);
+      }
+      stopping.assign(1, pid);
+      Reap(&stopping, c_exit_grace);
+      continue;
+    }
+
+    ServerReply reply = {-1};
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+      SendWithFd(fd, &reply, sizeof(reply), -1);
+      continue;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      // The worker only keeps its own end of its own socket, so it sees
+      // the client going away
+      CloseOtherFds(fds[1]);
+      WorkerMain(fn, fds[1]);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+      workers.push_back(pid);
+    }
+    reply.pid = pid;
+    SendWithFd(fd, &reply, sizeof(reply), pid < 0 ? -1 : fds[0]);
+    close(fds[0]);
+  }
+  Reap(&workers, c_exit_grace);
+  _exit(0);
+} /* ServerMain() */
+
+/***********************************************************
+* WorkerMain
+* Main loop of a worker process: evaluate each point that
+* arrives and send back its value, until the socket is
+* closed.
+***********************************************************/
+void ProcessPoolEvaluator::WorkerMain(const ObjectiveFn& fn, int fd)
+{
+  vectord point;
+  std::vector<double> coords;
+  while (true) {
+    uint64_t dim;
+    if (!ReadAll(fd, &dim, sizeof(dim))) {
+      _exit(0);
+    }
+    coords.resize(dim);
+    if (!ReadAll(fd, coords.data(), dim*sizeof(double))) {
+      _exit(0);
+    }
+    if (point.size() != dim) {
+      point.resize(dim, false);
+    }
+    std::copy(coords.begin(), coords.end(), point.begin());
+
+    WorkerReply reply = {0.0, 0};
+    try {
+      reply.value = fn(point);
+    } catch (...) {
+      reply.failed = 1;
+    }
+    if (!WriteAll(fd, &reply, sizeof(reply))) {
+      _exit(0);
+    }
+  }
+} /* WorkerMain() */
+
+}
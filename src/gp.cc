@@ -0,0 +1,217 @@
+#include "cpplogo/gp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace cpplogo {
+
+/***********************************************************
+* GaussianProcess constructor
+***********************************************************/
+GaussianProcess::GaussianProcess(int dim, double length_scale,
+                                 double signal_variance,
+                                 double noise_variance) :
+  dim_(dim), inv_length_scale2_(1.0 / (length_scale*length_scale)),
+  signal_variance_(signal_variance), noise_variance_(noise_variance),
+  mean_(0.0), m2_(0.0), points_(), values_(), chol_(), weights_(), ones_(),
+  solved_()
+{
+} /* GaussianProcess() */
+
+/***********************************************************
+* Add
+* Condition the model on one more observation.
+* Returns false if the point is too close to an earlier one
+* for the kernel matrix to stay positive definite, in which
+* case the observation is left out.
+***********************************************************/
+bool GaussianProcess::Add(const double* point, double value)
+{
+  const size_t n = size();
+
+  // The new row of L is [L^-1 k(X, point), sqrt(k(point, point) - |.|^2)]
+  SolveLower(point);
+  double dot = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    dot += solved_[i]*solved_[i];
+  }
+  double diag2 = signal_variance_ + noise_variance_ - dot;
+  if (diag2 <= 1e-12*signal_variance_) {
+    return false;
+  }
+  double diag = std::sqrt(diag2);
+  chol_.insert(chol_.end(), solved_.begin(), solved_.begin()+n);
+  chol_.push_back(diag);
+
+  // ...and forward substitution gives the new weights from the old ones
+  double sum = value;
+  double ones = 1.0;
+  for (size_t i = 0; i < n; i++) {
+    sum -= solved_[i]*weights_[i];
+    ones -= solved_[i]*ones_[i];
+  }
+  weights_.push_back(sum / diag);
+  ones_.push_back(ones / diag);
+
+  points_.insert(points_.end(), point, point+dim_);
+  values_.push_back(value);
+  double delta = value - mean_;
+  mean_ += delta / values_.size();
+  m2_ += delta * (value - mean_);
+  return true;
+} /* Add() */
+
+/***********************************************************
+* Shrink
+* Forget all but 'num_keep' observations: the best one and
+* the most recent others. The factorization is rebuilt
+* from them.
+***********************************************************/
+void GaussianProcess::Shrink(size_t num_keep)
+{
+  const size_t n = size();
+  if (n <= num_keep) {
+    return;
+  }
+  size_t best = std::max_element(values_.begin(), values_.end()) -
+                values_.begin();
+  size_t first = n - num_keep;
+  if (best >= first) {
+    first--;
+  }
+  std::vector<double> points;
+  std::vector<double> values;
+  points.swap(points_);
+  values.swap(values_);
+  chol_.clear();
+  weights_.clear();
+  ones_.clear();
+  mean_ = 0.0;
+  m2_ = 0.0;
+
+  if (num_keep > 0 && best < first) {
+    Add(&points[best*dim_], values[best]);
+  }
+  for (size_t i = first+1; i < n; i++) {
+    Add(&points[i*dim_], values[i]);
+  }
+} /* Shrink() */
+
+/***********************************************************
+* Predict
+* Posterior mean and variance of the value at 'point'. In
+* standardized units the weights are L^-1 (values - mean)
+* / scale, which is (weights_ - mean ones_) / scale.
+***********************************************************/
+void GaussianProcess::Predict(const double* point, double* mean,
+                              double* variance)
+{
+  const size_t n = size();
+  SolveLower(point);
+  double mu = mean_;
+  double dot = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    mu += solved_[i]*(weights_[i] - mean_*ones_[i]);
+    dot += solved_[i]*solved_[i];
+  }
+  double s = scale();
+  *mean = mu;
+  *variance = s*s * std::max(signal_variance_ - dot, 0.0);
+} /* Predict() */
+
+/***********************************************************
+* Save
+* Write the observations. The factorization is rebuilt from
+* them on load.
+***********************************************************/
+void GaussianProcess::Save(BinaryWriter* out) const
+{
+  out->WriteUInt(size());
+  for (double x : points_) {
+    out->WriteDouble(x);
+  }
+  for (double y : values_) {
+    out->WriteDouble(y);
+  }
+} /* Save() */
+
+/***********************************************************
+* Load
+* Replace the model with the one saved by Save. Adding the
+* observations again in the same order reproduces the
+* factorization exactly.
+***********************************************************/
+void GaussianProcess::Load(BinaryReader* in)
+{
+  size_t n = in->ReadUInt();
+  std::vector<double> points(n*dim_);
+  std::vector<double> values(n);
+  for (double& x : points) {
+    x = in->ReadDouble();
+  }
+  for (double& y : values) {
+    y = in->ReadDouble();
+  }
+
+  points_.clear();
+  values_.clear();
+  chol_.clear();
+  weights_.clear();
+  ones_.clear();
+  mean_ = 0.0;
+  m2_ = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    if (!Add(&points[i*dim_], values[i])) {
+      throw std::runtime_error("Bad Gaussian process in checkpoint");
+    }
+  }
+} /* Load() */
+
+/***********************************************************
+* Kernel
+* Squared exponential covariance between two points.
+***********************************************************/
+double GaussianProcess::Kernel(const double* a, const double* b) const
+{
+  double dist2 = 0.0;
+  for (int d = 0; d < dim_; d++) {
+    double diff = a[d] - b[d];
+    dist2 += diff*diff;
+  }
+  return signal_variance_ * std::exp(-0.5 * dist2 * inv_length_scale2_);
+} /* Kernel() */
+
+/***********************************************************
+* scale
+* Standard deviation of the values, which standardizes them.
+* Until they differ, the values are taken to be on a scale
+* of 1.
+***********************************************************/
+double GaussianProcess::scale() const
+{
+  double sd = size() > 1 ? std::sqrt(m2_ / size()) : 0.0;
+  return sd > 0.0 ? sd : 1.0;
+} /* scale() */
+
+/***********************************************************
+* SolveLower
+* Compute L^-1 k(X, point) into solved_ by forward
+* substitution.
+***********************************************************/
+void GaussianProcess::SolveLower(const double* point)
+{
+  const size_t n = size();
+  solved_.resize(n);
+  const double* row = chol_.data();
+  for (size_t i = 0; i < n; i++) {
+    double sum = Kernel(&points_[i*dim_], point);
+    for (size_t j = 0; j < i; j++) {
+      sum -= row[j]*solved_[j];
+    }
+    solved_[i] = sum / row[i];
+    row += i+1;
+  }
+} /* SolveLower() */
+
+}
@@ -0,0 +1,127 @@
+#include "cpplogo/journal.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cpplogo {
+
+/***********************************************************
+* Journal constructor
+* Nothing is recorded until Start is called.
+***********************************************************/
+Journal::Journal() :
+  active_(false), changes_(), record_()
+{
+} /* Journal() */
+
+/***********************************************************
+* Start
+* Start recording changes, forgetting any recorded before.
+***********************************************************/
+void Journal::Start()
+{
+  active_ = true;
+  changes_.clear();
+} /* Start() */
+
+/***********************************************************
+* Stop
+* Stop recording changes and forget the ones recorded.
+***********************************************************/
+void Journal::Stop()
+{
+  active_ = false;
+  changes_.clear();
+  changes_.shrink_to_fit();
+} /* Stop() */
+
+/***********************************************************
+* Erase
+* Record that there is no longer a record under 'key'.
+***********************************************************/
+void Journal::Erase(uint64_t key)
+{
+  BinaryWriter out(&changes_);
+  out.WriteUInt(key);
+  out.WriteUInt(0);
+} /* Erase() */
+
+/***********************************************************
+* Take
+* Move the changes recorded so far into 'changes' and start
+* over with none. The buffer is handed over rather than
+* copied.
+***********************************************************/
+void Journal::Take(std::string* changes)
+{
+  changes->clear();
+  changes->swap(changes_);
+} /* Take() */
+
+/***********************************************************
+* ReadKey
+* Read the key of the next record in a table, leaving 'in'
+* at the start of the record.
+***********************************************************/
+uint64_t Journal::ReadKey(BinaryReader* in)
+{
+  uint64_t key = in->ReadUInt();
+  if (in->ReadUInt() == 0) {
+    throw std::runtime_error("Erased record in checkpoint table");
+  }
+  return key;
+} /* ReadKey() */
+
+/***********************************************************
+* Fold
+* Apply lists of changes, in order, and write the records
+* that are left to 'table', sorted by key. The first list
+* is usually the table the others change. Only the readers'
+* positions change; the records are copied once, into
+* 'table'.
+***********************************************************/
+void Journal::Fold(std::vector<BinaryReader>* changes, std::string* table)
+{
+  struct Entry {
+    uint64_t key;
+    uint64_t size;      // Size of the record plus one, or 0 for an erase
+    const char* bytes;  // The record itself
+  };
+  std::vector<Entry> entries;
+  size_t first_size = 0;
+  for (BinaryReader& in : *changes) {
+    while (!in.AtEnd()) {
+      uint64_t key = in.ReadUInt();
+      uint64_t size = in.ReadUInt();
+      const char* bytes = in.ReadBytes(size > 0 ? size-1 : 0);
+      entries.push_back({key, size, bytes});
+    }
+    if (&in == &changes->front()) {
+      first_size = entries.size();
+    }
+  }
+
+  // The last change to each key is the one that counts. A table that was
+  // folded before is already sorted, so only the changes to it need to be.
+  auto by_key = [](const Entry& a, const Entry& b) { return a.key < b.key; };
+  auto middle = entries.begin() + first_size;
+  if (!std::is_sorted(entries.begin(), middle, by_key)) {
+    std::stable_sort(entries.begin(), middle, by_key);
+  }
+  std::stable_sort(middle, entries.end(), by_key);
+  std::inplace_merge(entries.begin(), middle, entries.end(), by_key);
+  table->clear();
+  BinaryWriter out(table);
+  for (size_t i = 0; i < entries.size(); i++) {
+    const Entry& entry = entries[i];
+    if ((i+1 < entries.size() && entries[i+1].key == entry.key) ||
+        entry.size == 0) {
+      continue;
+    }
+    out.WriteUInt(entry.key);
+    out.WriteUInt(entry.size);
+    out.WriteBytes(entry.bytes, entry.size-1);
+  }
+} /* Fold() */
+
+}
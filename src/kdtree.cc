@@ -0,0 +1,289 @@
+#include "cpplogo/kdtree.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cpplogo {
+
+namespace {
+
+// Trees smaller than this aren't worth rebuilding
+const size_t c_min_rebuild_size = 64;
+
+bool CloserThan(const KDTree::Neighbour& a, const KDTree::Neighbour& b)
+{
+  return a.dist2 < b.dist2;
+}
+
+}
+
+/***********************************************************
+* KDTree constructor
+***********************************************************/
+KDTree::KDTree(int dim) :
+  dim_(dim), points_(), values_(), nodes_(), root_(-1),
+  rebuild_size_(c_min_rebuild_size), order_(), journal_()
+{
+} /* KDTree() */
+
+/***********************************************************
+* Insert
+* Add a point to the tree as a new leaf.
+***********************************************************/
+void KDTree::Insert(const double* point, double value)
+{
+  int32_t index = values_.size();
+  points_.insert(points_.end(), point, point+dim_);
+  values_.push_back(value);
+  if (journal_.active()) {
+    journal_.Put(index, [this, point, value](BinaryWriter* out) {
+      for (int d = 0; d < dim_; d++) {
+        out->WriteDouble(point[d]);
+      }
+      out->WriteDouble(value);
+    });
+  }
+  nodes_.push_back({0, -1, -1});
+
+  if (root_ < 0) {
+    root_ = index;
+  } else {
+    int32_t node = root_;
+    while (true) {
+      TreeNode& tree_node = nodes_[node];
+      int32_t* child = point[tree_node.split_dim]
+                       < points_[node*dim_ + tree_node.split_dim]
+                       ? &tree_node.left : &tree_node.right;
+      if (*child < 0) {
+        *child = index;
+        nodes_[index].split_dim = (tree_node.split_dim+1) % dim_;
+        break;
+      }
+      node = *child;
+    }
+  }
+
+  if (size() >= rebuild_size_) {
+    Rebuild();
+    rebuild_size_ = 2*size();
+  }
+} /* Insert() */
+
+/***********************************************************
+* Nearest
+* Find the 'k' points closest to 'point' (or all of them,
+* if there are fewer), nearest first.
+* With a positive 'approximation', parts of the tree that
+* can't hold a point more than (1 + approximation) times
+* closer than the k-th neighbour found so far are skipped.
+* The i-th neighbour returned is then at most that factor
+* further away than the true i-th nearest point, and far
+* fewer points are looked at in higher dimensions.
+***********************************************************/
+void KDTree::Nearest(const double* point, size_t k,
+                     std::vector<Neighbour>* neighbours,
+                     double approximation) const
+{
+  neighbours->clear();
+  if (k == 0 || root_ < 0) {
+    return;
+  }
+  // 'neighbours' is kept as a max-heap on distance while searching
+  std::vector<double> offsets(dim_, 0.0);
+  double scale = (1.0 + approximation) * (1.0 + approximation);
+  Search(root_, point, k, scale, 0.0, offsets.data(), neighbours);
+  std::sort_heap(neighbours->begin(), neighbours->end(), CloserThan);
+} /* Nearest() */
+
+/***********************************************************
+* Clear
+* Remove every point.
+***********************************************************/
+void KDTree::Clear()
+{
+  points_.clear();
+  values_.clear();
+  nodes_.clear();
+  root_ = -1;
+  rebuild_size_ = c_min_rebuild_size;
+} /* Clear() */
+
+/***********************************************************
+* SaveTable
+* Write the points keyed by the order they were inserted
+* in. The tree is rebuilt from them on load.
+***********************************************************/
+void KDTree::SaveTable(std::string* records) const
+{
+  Journal table;
+  table.Start();
+  for (size_t i = 0; i < size(); i++) {
+    table.Put(i, [this, i](BinaryWriter* out) {
+      for (int d = 0; d < dim_; d++) {
+        out->WriteDouble(points_[i*dim_ + d]);
+      }
+      out->WriteDouble(values_[i]);
+    });
+  }
+  table.Take(records);
+} /* SaveTable() */
+
+/***********************************************************
+* LoadTable
+* Replace the tree with the one saved by SaveTable, and
+* stop the journal. Inserting the points again in the same
+* order reproduces the tree exactly, so queries give the
+* same answers as before.
+***********************************************************/
+void KDTree::LoadTable(const std::string& records)
+{
+  journal_.Stop();
+  Clear();
+  BinaryReader in(&records);
+  std::vector<double> point(dim_);
+  while (!in.AtEnd()) {
+    if (Journal::ReadKey(&in) != size()) {
+      throw std::runtime_error("Points missing from checkpoint");
+    }
+    for (double& x : point) {
+      x = in.ReadDouble();
+    }
+    double value = in.ReadDouble();
+    Insert(point.data(), value);
+  }
+} /* LoadTable() */
+
+/***********************************************************
+* StartJournal
+* Write every point to 'records', as SaveTable does, and
+* start recording the points inserted from here on.
+***********************************************************/
+void KDTree::StartJournal(std::string* records)
+{
+  journal_.Start();
+  SaveTable(records);
+} /* StartJournal() */
+
+/***********************************************************
+* TakeChanges
+* Move the points inserted since the journal was started,
+* or since the last call, into 'changes'.
+***********************************************************/
+void KDTree::TakeChanges(std::string* changes)
+{
+  journal_.Take(changes);
+} /* TakeChanges() */
+
+/***********************************************************
+* Rebuild
+* Rebuild the whole tree balanced.
+***********************************************************/
+void KDTree::Rebuild()
+{
+  order_.resize(size());
+  for (size_t i = 0; i < order_.size(); i++) {
+    order_[i] = i;
+  }
+  root_ = Build(order_.data(), order_.data()+order_.size());
+} /* Rebuild() */
+
+/***********************************************************
+* Build
+* Build a balanced subtree from the points in
+* [begin, end), splitting at the median of the dimension
+* they are most spread out along. Returns its root.
+***********************************************************/
+int32_t KDTree::Build(uint32_t* begin, uint32_t* end)
+{
+  if (begin == end) {
+    return -1;
+  }
+
+  int split_dim = 0;
+  double max_spread = -1.0;
+  for (int d = 0; d < dim_; d++) {
+    double lo = points_[*begin*dim_ + d];
+    double hi = lo;
+    for (uint32_t* it = begin+1; it != end; ++it) {
+      double x = points_[*it*dim_ + d];
+      lo = std::min(lo, x);
+      hi = std::max(hi, x);
+    }
+    if (hi - lo > max_spread) {
+      max_spread = hi - lo;
+      split_dim = d;
+    }
+  }
+
+  uint32_t* mid = begin + (end-begin)/2;
+  std::nth_element(begin, mid, end, [&](uint32_t a, uint32_t b) {
+    return points_[a*dim_ + split_dim] < points_[b*dim_ + split_dim];
+  });
+  // Points equal to the median along split_dim must end up on the right,
+  // the same side Insert and Search put them
+  double split = points_[*mid*dim_ + split_dim];
+  mid = std::partition(begin, mid, [&](uint32_t a) {
+    return points_[a*dim_ + split_dim] < split;
+  });
+  std::iter_swap(mid, std::min_element(mid, end, [&](uint32_t a, uint32_t b) {
+    return points_[a*dim_ + split_dim] < points_[b*dim_ + split_dim];
+  }));
+
+  int32_t node = *mid;
+  nodes_[node].split_dim = split_dim;
+  nodes_[node].left = Build(begin, mid);
+  nodes_[node].right = Build(mid+1, end);
+  return node;
+} /* Build() */
+
+/***********************************************************
+* Search
+* Look for neighbours in the subtree under 'node', nearer
+* side first. 'offsets' holds how far the query is from the
+* subtree's cell along each dimension, and 'rect_dist2' the
+* sum of their squares: the squared distance to the nearest
+* point the cell could hold. Cells that are further away
+* than the k-th neighbour so far, once their squared
+* distance is multiplied by 'scale', are skipped.
+***********************************************************/
+void KDTree::Search(int32_t node, const double* point, size_t k,
+                    double scale, double rect_dist2, double* offsets,
+                    std::vector<Neighbour>* neighbours) const
+{
+  if (node < 0) {
+    return;
+  }
+
+  const double* node_point = &points_[node*dim_];
+  double dist2 = 0.0;
+  for (int d = 0; d < dim_; d++) {
+    double diff = point[d] - node_point[d];
+    dist2 += diff*diff;
+  }
+  if (neighbours->size() < k) {
+    neighbours->push_back({static_cast<size_t>(node), dist2});
+    std::push_heap(neighbours->begin(), neighbours->end(), CloserThan);
+  } else if (dist2 < neighbours->front().dist2) {
+    std::pop_heap(neighbours->begin(), neighbours->end(), CloserThan);
+    neighbours->back() = {static_cast<size_t>(node), dist2};
+    std::push_heap(neighbours->begin(), neighbours->end(), CloserThan);
+  }
+
+  const TreeNode& tree_node = nodes_[node];
+  const int split_dim = tree_node.split_dim;
+  double diff = point[split_dim] - node_point[split_dim];
+  Search(diff < 0 ? tree_node.left : tree_node.right, point, k, scale,
+         rect_dist2, offsets, neighbours);
+
+  // The far cell is only further away along split_dim
+  double offset = offsets[split_dim];
+  rect_dist2 += diff*diff - offset*offset;
+  if (neighbours->size() < k || scale*rect_dist2 < neighbours->front().dist2) {
+    offsets[split_dim] = diff;
+    Search(diff < 0 ? tree_node.right : tree_node.left, point, k, scale,
+           rect_dist2, offsets, neighbours);
+    offsets[split_dim] = offset;
+  }
+} /* Search() */
+
+}
@@ -0,0 +1,148 @@
+#include "cpplogo/lipschitz.h"
+#include "cpplogo/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace cpplogo {
+
+/***********************************************************
+* ObserveLipschitz constructor
+***********************************************************/
+ObserveLipschitz::ObserveLipschitz(const Options& opt, int dim) :
+  fixed_constant_(opt.lipschitz_constant), factor_(opt.lipschitz_factor),
+  num_neighbours_(std::max<size_t>(opt.screen_neighbours, 1)),
+  approximation_(opt.screen_approximation), tree_(dim),
+  max_slope_(0.0), num_fake_values_(0), center_(dim), neighbours_(),
+  to_evaluate_()
+{
+} /* ObserveLipschitz() */
+
+/***********************************************************
+* Screen
+* Decide which of the pending nodes need to be evaluated,
+* and give the rest of them fake values.
+***********************************************************/
+void ObserveLipschitz::Screen(const std::vector<Node*>& pending,
+                              double best_value)
+{
+  to_evaluate_.clear();
+  const double lipschitz = lipschitz_constant();
+  if (tree_.size() < num_neighbours_ || lipschitz <= 0.0) {
+    to_evaluate_ = pending;
+    return;
+  }
+
+  for (Node* node : pending) {
+    for (size_t d = 0; d < center_.size(); d++) {
+      center_[d] = node->center(d);
+    }
+    tree_.Nearest(center_.data(), num_neighbours_, &neighbours_,
+                  approximation_);
+
+    double bound = std::numeric_limits<double>::infinity();
+    double weighted_sum = 0.0;
+    double total_weight = 0.0;
+    for (const KDTree::Neighbour& neighbour : neighbours_) {
+      double value = tree_.value(neighbour.index);
+      bound = std::min(bound, value + lipschitz*std::sqrt(neighbour.dist2));
+      double weight = 1.0 / std::max(neighbour.dist2, 1e-300);
+      weighted_sum += weight*value;
+      total_weight += weight;
+    }
+
+    if (bound >= best_value) {
+      to_evaluate_.push_back(node);
+    } else {
+      node->SetFakeValue(std::min(weighted_sum/total_weight, bound));
+      num_fake_values_++;
+      LOG(trace) << "Fake value: " << *node;
+    }
+  }
+} /* Screen() */
+
+/***********************************************************
+* Record
+* Add a real observation to the tree, first updating the
+* steepest slope with the one to its nearest neighbour.
+***********************************************************/
+void ObserveLipschitz::Record(const Node& node)
+{
+  for (size_t d = 0; d < center_.size(); d++) {
+    center_[d] = node.center(d);
+  }
+  tree_.Nearest(center_.data(), 1, &neighbours_, approximation_);
+  if (!neighbours_.empty() && neighbours_[0].dist2 > 0.0) {
+    double slope = std::abs(node.value() - tree_.value(neighbours_[0].index))
+                   / std::sqrt(neighbours_[0].dist2);
+    max_slope_ = std::max(max_slope_, slope);
+  }
+  tree_.Insert(center_.data(), node.value());
+} /* Record() */
+
+/***********************************************************
+* lipschitz_constant
+* Lipschitz constant the bounds are currently computed with.
+***********************************************************/
+double ObserveLipschitz::lipschitz_constant() const
+{
+  return fixed_constant_ > 0.0 ? fixed_constant_ : factor_*max_slope_;
+} /* lipschitz_constant() */
+
+/***********************************************************
+* Save
+***********************************************************/
+void ObserveLipschitz::Save(BinaryWriter* out) const
+{
+  out->WriteDouble(max_slope_);
+  out->WriteUInt(num_fake_values_);
+} /* Save() */
+
+/***********************************************************
+* Load
+***********************************************************/
+void ObserveLipschitz::Load(BinaryReader* in)
+{
+  max_slope_ = in->ReadDouble();
+  num_fake_values_ = in->ReadUInt();
+} /* Load() */
+
+/***********************************************************
+* SaveTables
+* The observations in the tree are a table of their own.
+***********************************************************/
+void ObserveLipschitz::SaveTables(std::vector<std::string>* tables) const
+{
+  tables->emplace_back();
+  tree_.SaveTable(&tables->back());
+} /* SaveTables() */
+
+/***********************************************************
+* JournalTables
+***********************************************************/
+void ObserveLipschitz::JournalTables(std::vector<std::string>* tables,
+                                     bool restart)
+{
+  tables->emplace_back();
+  if (restart) {
+    tree_.StartJournal(&tables->back());
+  } else {
+    tree_.TakeChanges(&tables->back());
+  }
+} /* JournalTables() */
+
+/***********************************************************
+* LoadTables
+***********************************************************/
+void ObserveLipschitz::LoadTables(const std::vector<std::string>& tables,
+                                  size_t* next)
+{
+  if (*next >= tables.size()) {
+    throw std::runtime_error("Checkpoint doesn't match this optimizer");
+  }
+  tree_.LoadTable(tables[(*next)++]);
+} /* LoadTables() */
+
+}
@@ -29,10 +29,13 @@ std::ostream& operator<< (std::ostream& strm, log_severity_level level)
 * Set up logging options. 
 * Should be expanded to allow for user control.
 ***********************************************************/
+log_severity_level min_log_level = trace;
+
 BOOST_LOG_ATTRIBUTE_KEYWORD(severity, "Severity", log_severity_level)
 void init_logging(log_severity_level l)
 {
   log_severity_level min_level = l;
+  min_log_level = l;
   logging::add_console_log(
     std::cout,
     keywords::format = (
@@ -50,7 +53,9 @@ namespace cpplogo {
 
 boost::iostreams::stream<boost::iostreams::null_sink> null_stream(boost::iostreams::null_sink{});
 
-void init_logging(log_severity_level l) {(void)l;}
+log_severity_level min_log_level = trace;
+
+void init_logging(log_severity_level l) { min_log_level = l; }
 
 }
 
@@ -1,27 +1,85 @@
 #include "cpplogo/logo.h"
 #include "cpplogo/logging.h"
 
+#include <algorithm>
+
 namespace cpplogo {
 
 /***********************************************************
-* LOGO constructor
+* DepthSets constructor
 ***********************************************************/
-LOGO::LOGO(const Options& opt) :
-  SOO(opt), w_schedule_(opt.w_schedule), depthset_width_(w_schedule_[0]),
+DepthSets::DepthSets(const Options& opt, int dim) :
+  w_schedule_(opt.w_schedule), depthset_width_(w_schedule_[0]),
   last_best_obs_(-std::numeric_limits<double>::infinity())
 {
-} /* LOGO() */
+  (void)dim;
+} /* DepthSets() */
+
+/***********************************************************
+* MaxDepth
+* Calculate the maximum depth set for this step from the
+* maximum depth SOO would use.
+***********************************************************/
+size_t DepthSets::MaxDepth(size_t max_depth) const
+{
+  return max_depth / depthset_width_;
+} /* MaxDepth() */
+
+/***********************************************************
+* DeepestDepth
+* Deepest depth any depth set up to MaxDepth(max_depth) can
+* reach, for any of the widths in the schedule.
+***********************************************************/
+size_t DepthSets::DeepestDepth(size_t max_depth) const
+{
+  int max_width = *std::max_element(w_schedule_.begin(), w_schedule_.end());
+  return max_depth + max_width - 1;
+} /* DeepestDepth() */
+
+/***********************************************************
+* Best
+* Find the best node in the specified depth set.
+* NOTE: In this case, a single 'depth' level encompasses
+* multiple depth levels in the space, according to the 
+* width.
+***********************************************************/
+const Node* DepthSets::Best(const std::vector<DepthLevel>& space,
+                            size_t depthset_id) const
+{
+  // Find the minimum/maximum 'true' depth levels for this depth index
+  size_t min_depth = depthset_id*depthset_width_;
+  size_t max_depth = min_depth+depthset_width_-1;
+  LOG(trace) << "Considering nodes from " << min_depth << "-" << max_depth;
+
+  // Find the best node within those depths
+  const Node* best_node = nullptr;
+  for (size_t d = min_depth; d <= max_depth && d < space.size(); d++) {
+    const Node* depth_best = space[d].Best();
+    if (depth_best == nullptr) {
+      continue;
+    }
+    if (best_node == nullptr || depth_best->value() > best_node->value()) {
+      best_node = depth_best;
+    }
+  }
+  return best_node;
+} /* Best() */
 
 /***********************************************************
 * EndStep
 * Executed at the end of each optimization step.
 ***********************************************************/
-void LOGO::EndStep()
+void DepthSets::EndStep(const std::vector<Node>& step_observed_nodes)
 {
+  // Steps where every new node got a fake value say nothing about progress
+  if (step_observed_nodes.empty()) {
+    return;
+  }
+
   // Find the best node that was observed in this step
-  auto comp = [](const Node a, const Node b){return a.value() < b.value();};
-  const auto step_best_node = std::max_element(step_observed_nodes_.begin(), 
-                                               step_observed_nodes_.end(), 
+  auto comp = [](const Node& a, const Node& b){return a.value() < b.value();};
+  const auto step_best_node = std::max_element(step_observed_nodes.begin(), 
+                                               step_observed_nodes.end(), 
                                                comp);
   double step_best = (*step_best_node).value();
   LOG(trace) << "Previous best: " << last_best_obs_ << ", step best: " << step_best;
@@ -50,42 +108,21 @@ void LOGO::EndStep()
 } /* EndStep() */
 
 /***********************************************************
-* CalculateMaxDepth
-* Calculate the maximum depth for this algorithm.
+* Save
 ***********************************************************/
-size_t LOGO::CalculateMaxDepth() const
+void DepthSets::Save(BinaryWriter* out) const
 {
-  size_t soo_depth = SOO::CalculateMaxDepth();
-  return soo_depth / depthset_width_;
-} /* CalculateMaxDepth() */
+  out->WriteUInt(depthset_width_);
+  out->WriteDouble(last_best_obs_);
+} /* Save() */
 
 /***********************************************************
-* BestNodeAtDepth
-* Find the best node at the specified 'depth' level.
-* NOTE: In this case, a single 'depth' level encompasses
-* multiple depth levels in the space, according to the 
-* width.
+* Load
 ***********************************************************/
-const Node* LOGO::BestNodeAtDepth(size_t depthset_id) const
+void DepthSets::Load(BinaryReader* in)
 {
-  // Find the minimum/maximum 'true' depth levels for this depth index
-  size_t min_depth = depthset_id*depthset_width_;
-  size_t max_depth = min_depth+depthset_width_-1;
-  LOG(trace) << "Considering nodes from " << min_depth << "-" << max_depth;
-
-  // Find the best node within those depths
-  const Node* best_node = nullptr;
-  for (size_t d = min_depth; d <= max_depth; d++) {
-    const Node* depth_best = SOO::BestNodeAtDepth(d);   
-    if (depth_best == nullptr) {
-      continue;
-    }
-    if (best_node == nullptr || depth_best->value() > best_node->value()) {
-      best_node = depth_best;
-    }
-  }
-  return best_node;
-} /* ExpandBestAtDepth() */
+  depthset_width_ = in->ReadUInt();
+  last_best_obs_ = in->ReadDouble();
+} /* Load() */
 
 }
-
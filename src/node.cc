@@ -1,13 +1,15 @@
 #include "cpplogo/node.h"
 
+#include <stdexcept>
+
 namespace cpplogo {
 
 /***********************************************************
 * Node constructor
 ***********************************************************/
-Node::Node(vectord edges, vectord sizes, int depth) :
-  edges_(edges), sizes_(sizes), depth_(depth), value_(), has_value_(false), 
-  is_fake_value_(false)
+Node::Node(const NodeArena* arena, NodeArena::Handle handle, int depth) :
+  arena_(arena), handle_(handle), depth_(depth), value_(), has_value_(false), 
+  is_fake_value_(false), is_low_fidelity_(false)
 {
 } /* Node() */
 
@@ -20,6 +22,7 @@ void Node::SetValue(double value)
   value_ = value;
   has_value_ = true;
   is_fake_value_ = false;
+  is_low_fidelity_ = false;
 } /* SetValue() */
 
 /***********************************************************
@@ -31,8 +34,23 @@ void Node::SetFakeValue(double value)
   value_ = value;
   has_value_ = true;
   is_fake_value_ = true;
+  is_low_fidelity_ = false;
 } /* SetFakeValue() */
 
+/***********************************************************
+* SetLowFidelityValue
+* Sets a value observed with a low fidelity objective,
+* which stands in for the real value until the node is
+* promoted.
+***********************************************************/
+void Node::SetLowFidelityValue(double value)
+{
+  value_ = value;
+  has_value_ = true;
+  is_fake_value_ = false;
+  is_low_fidelity_ = true;
+} /* SetLowFidelityValue() */
+
 /***********************************************************
 * Center
 * Returns the center point of the node (where observations
@@ -40,20 +58,99 @@ void Node::SetFakeValue(double value)
 ***********************************************************/
 vectord Node::Center() const
 {
-  vectord center = edges_;
-  assert(center.size() == sizes_.size());
+  vectord center(dim());
   for (size_t i = 0; i < center.size(); i++) {
-    center[i] += sizes_[i]/2.0; 
+    center[i] = this->center(i);
   }
   return center;
 } /* Center() */
 
+/***********************************************************
+* edges
+* Returns a copy of the node's edge in every dimension.
+***********************************************************/
+vectord Node::edges() const
+{
+  vectord edges(dim());
+  for (size_t i = 0; i < edges.size(); i++) {
+    edges[i] = edge(i);
+  }
+  return edges;
+} /* edges() */
+
+/***********************************************************
+* sizes
+* Returns a copy of the node's size in every dimension.
+***********************************************************/
+vectord Node::sizes() const
+{
+  vectord sizes(dim());
+  for (size_t i = 0; i < sizes.size(); i++) {
+    sizes[i] = size(i);
+  }
+  return sizes;
+} /* sizes() */
+
+/***********************************************************
+* Save
+* Write the node, including its geometry.
+***********************************************************/
+void Node::Save(BinaryWriter* out) const
+{
+  out->WriteUInt(depth_);
+  out->WriteUInt(has_value_ + 2*is_fake_value_ + 4*is_low_fidelity_);
+  out->WriteDouble(value_);
+  for (int d = 0; d < dim(); d++) {
+    out->WriteUInt(arena_->code(handle_, d));
+  }
+} /* Save() */
+
+/***********************************************************
+* Load
+* Read a node written by Save, storing its geometry in a
+* new slot of 'arena'.
+***********************************************************/
+Node Node::Load(BinaryReader* in, NodeArena* arena)
+{
+  int depth = in->ReadUInt();
+  uint64_t flags = in->ReadUInt();
+  double value = in->ReadDouble();
+  NodeArena::Handle handle = arena->Allocate();
+  for (int d = 0; d < arena->dim(); d++) {
+    NodeArena::Code code = in->ReadUInt();
+    if (code == 0) {
+      throw std::runtime_error("Bad node in checkpoint");
+    }
+    arena->SetCode(handle, d, code);
+  }
+
+  Node node(arena, handle, depth);
+  if (flags & 4) {
+    node.SetLowFidelityValue(value);
+  } else if (flags & 2) {
+    node.SetFakeValue(value);
+  } else if (flags & 1) {
+    node.SetValue(value);
+  }
+  return node;
+} /* Load() */
+
 /***********************************************************
 * Node pretty printer
+* Writes the vectors out element by element (in the same
+* format as ublas) so printing a node doesn't allocate.
 ***********************************************************/
 std::ostream& operator<<(std::ostream& os, const Node& n)
 {
-  os << "Node(" << n.Center() << ", " << n.sizes();
+  os << "Node([" << n.dim() << "](";
+  for (int i = 0; i < n.dim(); i++) {
+    os << (i > 0 ? "," : "") << n.center(i);
+  }
+  os << "), [" << n.dim() << "](";
+  for (int i = 0; i < n.dim(); i++) {
+    os << (i > 0 ? "," : "") << n.size(i);
+  }
+  os << ")";
   if (n.has_value()) {
     os << ", " << n.value();
   }
@@ -0,0 +1,220 @@
+#include "cpplogo/nodearena.h"
+
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace cpplogo {
+
+/***********************************************************
+* NodeArena constructor
+* Precompute the powers of num_children used to decode the
+* cell codes.
+***********************************************************/
+NodeArena::NodeArena(int dim, int num_children) :
+  dim_(dim), num_children_(num_children), num_slots_(0), codes_(dim),
+  code_bytes_(1), max_stored_code_(std::numeric_limits<uint8_t>::max()),
+  free_(), retired_(), powers_(), splits_for_bits_(64), max_split_code_(),
+  max_splits_(0)
+{
+  assert(num_children_ >= 2);
+  const Code max_code = std::numeric_limits<Code>::max();
+  max_split_code_ = (max_code - (num_children_-1)) / num_children_;
+
+  Code power = 1;
+  powers_.push_back(power);
+  while (power <= max_code / num_children_) {
+    power *= num_children_;
+    powers_.push_back(power);
+  }
+
+  // A cell split k times has a code below 2*num_children^k, so its children
+  // fit as long as 2*num_children^(k+1) does
+  while (max_splits_+1 < static_cast<int>(powers_.size()) &&
+         powers_[max_splits_+1] <= (Code(1) << 63)) {
+    max_splits_++;
+  }
+
+  for (int bits = 0; bits < 64; bits++) {
+    Code bit_value = Code(1) << bits;
+    int k = 0;
+    while (k+1 < static_cast<int>(powers_.size()) && powers_[k+1] <= bit_value) {
+      k++;
+    }
+    splits_for_bits_[bits] = k;
+  }
+} /* NodeArena() */
+
+/***********************************************************
+* Allocate
+* Returns the handle of an unused slot, growing the buffers
+* only if there are no recycled slots left.
+* The geometry of the new slot is unspecified.
+***********************************************************/
+NodeArena::Handle NodeArena::Allocate()
+{
+  if (!free_.empty()) {
+    Handle handle = free_.back();
+    free_.pop_back();
+    return handle;
+  }
+
+  Handle handle = static_cast<Handle>(num_slots_++);
+  for (int d = 0; d < dim_; d++) {
+    codes_[d].resize(num_slots_*code_bytes_);
+    Store(handle, d, 1);
+  }
+  return handle;
+} /* Allocate() */
+
+/***********************************************************
+* Retire
+* Mark a slot as no longer in use. Its geometry stays valid
+* until the next call to Recycle, so copies of the node that
+* used it can still be read in the meantime.
+***********************************************************/
+void NodeArena::Retire(Handle handle)
+{
+  retired_.push_back(handle);
+} /* Retire() */
+
+/***********************************************************
+* Recycle
+* Make all retired slots available to Allocate.
+***********************************************************/
+void NodeArena::Recycle()
+{
+  free_.insert(free_.end(), retired_.begin(), retired_.end());
+  retired_.clear();
+} /* Recycle() */
+
+/***********************************************************
+* InitRoot
+* Give a slot the geometry of the whole unit hypercube.
+***********************************************************/
+void NodeArena::InitRoot(Handle handle)
+{
+  for (int d = 0; d < dim_; d++) {
+    Store(handle, d, 1);
+  }
+} /* InitRoot() */
+
+/***********************************************************
+* CopyGeometry
+* Copy the geometry of one slot into another.
+***********************************************************/
+void NodeArena::CopyGeometry(Handle from, Handle to)
+{
+  for (int d = 0; d < dim_; d++) {
+    uint8_t* codes = codes_[d].data();
+    std::memcpy(codes + to*code_bytes_, codes + from*code_bytes_, code_bytes_);
+  }
+} /* CopyGeometry() */
+
+/***********************************************************
+* Split
+* Turn the cell in 'handle' into its 'child'th child along
+* dimension 'd'.
+* Throws if the cell is already split as finely as a 64 bit
+* code can describe, which is far below the spacing of
+* doubles, so the children's centers would all be the same.
+***********************************************************/
+void NodeArena::Split(Handle handle, size_t d, int child)
+{
+  Code code = this->code(handle, d);
+  if (code > max_split_code_) {
+    throw std::runtime_error("Node split more finely than its cell code "
+                             "can describe");
+  }
+  Store(handle, d, code*num_children_ + child);
+} /* Split() */
+
+/***********************************************************
+* SetCode
+* Directly set the cell code of a slot along dimension d.
+***********************************************************/
+void NodeArena::SetCode(Handle handle, size_t d, Code code)
+{
+  assert(code > 0);
+  Store(handle, d, code);
+} /* SetCode() */
+
+/***********************************************************
+* WriteCode
+* Store a code in 'width' bytes.
+***********************************************************/
+void NodeArena::WriteCode(uint8_t* bytes, size_t width, Code code)
+{
+  switch (width) {
+    case 1:
+      *bytes = static_cast<uint8_t>(code);
+      break;
+    case 2: {
+      uint16_t narrow = static_cast<uint16_t>(code);
+      std::memcpy(bytes, &narrow, sizeof(narrow));
+      break;
+    }
+    case 4: {
+      uint32_t narrow = static_cast<uint32_t>(code);
+      std::memcpy(bytes, &narrow, sizeof(narrow));
+      break;
+    }
+    default:
+      std::memcpy(bytes, &code, sizeof(code));
+      break;
+  }
+} /* WriteCode() */
+
+/***********************************************************
+* Store
+* Write a cell code into a slot, widening the buffers first
+* if it doesn't fit.
+***********************************************************/
+void NodeArena::Store(Handle handle, size_t d, Code code)
+{
+  if (code > max_stored_code_) {
+    Widen(code);
+  }
+  WriteCode(codes_[d].data() + handle*code_bytes_, code_bytes_, code);
+} /* Store() */
+
+/***********************************************************
+* Widen
+* Rewrite every buffer with codes wide enough for 'code'.
+***********************************************************/
+void NodeArena::Widen(Code code)
+{
+  size_t code_bytes = code_bytes_;
+  Code max_code = max_stored_code_;
+  while (code > max_code) {
+    code_bytes *= 2;
+    max_code = code_bytes == sizeof(Code) ? std::numeric_limits<Code>::max()
+                                          : (Code(1) << 8*code_bytes) - 1;
+  }
+
+  for (auto& codes : codes_) {
+    std::vector<uint8_t> wide(num_slots_*code_bytes);
+    for (size_t slot = 0; slot < num_slots_; slot++) {
+      WriteCode(wide.data() + slot*code_bytes, code_bytes,
+                ReadCode(codes.data() + slot*code_bytes_, code_bytes_));
+    }
+    codes.swap(wide);
+  }
+  code_bytes_ = code_bytes;
+  max_stored_code_ = max_code;
+} /* Widen() */
+
+/***********************************************************
+* num_bytes
+* Memory held by the arena's buffers.
+***********************************************************/
+size_t NodeArena::num_bytes() const
+{
+  size_t bytes = (free_.capacity() + retired_.capacity())*sizeof(Handle);
+  for (const auto& codes : codes_) {
+    bytes += codes.capacity();
+  }
+  return bytes;
+} /* num_bytes() */
+
+}
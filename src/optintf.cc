@@ -1,5 +1,11 @@
 #include "cpplogo/optintf.h"
 
+#include "cpplogo/checkpoint.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
 namespace cpplogo {
 
 /***********************************************************
@@ -7,13 +13,45 @@ namespace cpplogo {
 ***********************************************************/
 OptIntf::OptIntf(const Options& opt) :
   fn_(opt.fn), dim_(opt.dim), max_observations_(opt.max_observations), 
-  num_observations_(0) 
+  domain_(opt.dim, opt.bounds), batch_fn_(opt.batch_fn), evaluator_(opt.evaluator), cache_(opt.cache),
+  trace_(opt.trace), max_seconds_(opt.max_seconds), target_value_(opt.target_value),
+  stall_observations_(opt.stall_observations),
+  stall_tolerance_(opt.stall_tolerance), fidelities_(opt.fidelities),
+  num_observations_(0), num_steps_(0),
+  tell_nanoseconds_(0), stats_(),
+  phase_(StepPhase::begin), phase_depth_(0), waiting_(false), ask_points_(),
+  ask_fidelity_(-1), tell_values_(), no_points_(0, opt.dim), clock_started_(false),
+  start_time_(), last_batch_(), max_batch_interval_(0.0),
+  stall_best_(-std::numeric_limits<double>::infinity()), stall_start_(0),
+  stop_flag_(), batch_hook_(), hook_reason_(StopReason::none),
+  journaling_(false)
 {
+  bool any_fn = static_cast<bool>(fn_);
+  for (const Fidelity& fidelity : fidelities_) {
+    any_fn = any_fn || fidelity.fn;
+  }
+  if (!evaluator_ && any_fn) {
+    evaluator_ = std::make_shared<ThreadPoolEvaluator>();
+  }
+  // Rungs without a batch objective go through the evaluator, which has to
+  // be able to run them rather than the objective it was made with
+  for (const Fidelity& fidelity : fidelities_) {
+    if (fidelity.fn && !fidelity.batch_fn && !evaluator_->runs_any_fn()) {
+      throw std::runtime_error("Evaluator can only run its own objective; "
+                               "give every rung of the fidelity ladder a "
+                               "batch_fn");
+    }
+  }
+  if (trace_ && trace_->dim() != dim_) {
+    throw std::runtime_error("Trace dimension doesn't match");
+  }
 } /* OptIntf() */
 
 /***********************************************************
 * Optimize
-* Keep executing optimization steps until finished.
+* Keep executing optimization steps until finished. May
+* return in the middle of a step if the run is stopped
+* early.
 ***********************************************************/
 void OptIntf::Optimize() 
 {
@@ -24,26 +62,407 @@ void OptIntf::Optimize()
 
 /***********************************************************
 * Step
-* Execute a single step of the optimization procudure.
+* Execute a single step of the optimization procudure (or
+* the rest of the current one, if it was started through
+* Ask), evaluating the points it asks for with the
+* objective. Returns without finishing the step if the run
+* is stopped early.
 ***********************************************************/
 void OptIntf::Step() {
-  BeginStep();
+  StartClock();
+  while (waiting_ || !Advance()) {
+    if (StopBeforeBatch()) {
+      return;
+    }
+    EvaluatePoints(ask_points_, ask_fidelity_, &tell_values_);
+    Tell(tell_values_);
+  }
+} /* Step() */
 
-  // For each 'depth level', expand the best node at that
-  // depth.
-  for (size_t depth = 0; depth <= CalculateMaxDepth(); depth++) {
-    ExpandBestAtDepth(depth);
+/***********************************************************
+* Ask
+* Run the optimization forward until it needs the values of
+* some points, and return those points, one per row. They
+* are to be evaluated with the objective, or with the rung
+* of the fidelity ladder given by ask_fidelity(). Asking
+* again before telling returns the same points. Returns an
+* empty matrix once the optimization is finished, which can
+* happen in the middle of a step if it is stopped early.
+***********************************************************/
+const matrixd& OptIntf::Ask()
+{
+  StartClock();
+  if (waiting_) {
+    return EarlyStopReason() == StopReason::none ? ask_points_ : no_points_;
+  }
+  while (!waiting_) {
+    // The budget of observations is only checked between steps, the same
+    // as Optimize does
+    if (phase_ == StepPhase::begin && IsFinished()) {
+      return no_points_;
+    }
+    Advance();
   }
+  return StopBeforeBatch() ? no_points_ : ask_points_;
+} /* Ask() */
 
-  EndStep();
-} /* Step() */
+/***********************************************************
+* Tell
+* Give the values of the points returned by Ask, in the
+* same order.
+***********************************************************/
+void OptIntf::Tell(const vectord& values)
+{
+  if (!waiting_) {
+    throw std::runtime_error("Told values that weren't asked for");
+  }
+  if (values.size() != ask_points_.size1()) {
+    throw std::runtime_error("Told the wrong number of values");
+  }
+  waiting_ = false;
+  if (trace_) {
+    tell_nanoseconds_ = trace_->Now();
+  }
+  ReceiveValues(values);
+
+  if (num_observations_ > 0 && best_value() > stall_best_ + stall_tolerance_) {
+    stall_best_ = best_value();
+    stall_start_ = num_observations_;
+  }
+} /* Tell() */
+
+/***********************************************************
+* Advance
+* Run the current step forward until it is finished or it
+* needs values. Returns true if the step was finished.
+***********************************************************/
+bool OptIntf::Advance()
+{
+  return AdvancePhases(this);
+} /* Advance() */
+
+/***********************************************************
+* StartClock
+* Start the clock for the deadline, unless it already is.
+***********************************************************/
+void OptIntf::StartClock()
+{
+  if (!clock_started_) {
+    clock_started_ = true;
+    start_time_ = Stats::clock::now();
+    last_batch_ = start_time_;
+  }
+} /* StartClock() */
+
+/***********************************************************
+* StopBeforeBatch
+* Called whenever a new batch of points is about to be
+* handed out. Keeps track of the longest time between two
+* batches, and returns true if the run should stop early
+* instead. The batch hook is only asked once the run's own
+* conditions have let the batch go ahead.
+***********************************************************/
+bool OptIntf::StopBeforeBatch()
+{
+  auto now = Stats::clock::now();
+  std::chrono::duration<double> interval = now - last_batch_;
+  max_batch_interval_ = std::max(max_batch_interval_, interval.count());
+  last_batch_ = now;
+  if (EarlyStopReason() != StopReason::none) {
+    return true;
+  }
+  if (batch_hook_) {
+    hook_reason_ = batch_hook_(*this, ask_fidelity_ < 0
+                                      ? static_cast<int>(ask_points_.size1())
+                                      : 0);
+  }
+  return hook_reason_ != StopReason::none;
+} /* StopBeforeBatch() */
+
+/***********************************************************
+* EarlyStopReason
+* Returns why the run should stop before its budget of
+* observations is spent, if it should.
+* The deadline counts as reached as soon as another batch
+* might not make it in time, judging by the longest time
+* any batch took so far (including the bookkeeping up to
+* the next one). So the run ends before the deadline unless
+* a batch takes longer than every one before it, and then
+* it overruns by at most the difference.
+***********************************************************/
+OptIntf::StopReason OptIntf::EarlyStopReason() const
+{
+  if (hook_reason_ != StopReason::none) {
+    return hook_reason_;
+  }
+  if (stop_flag_ && stop_flag_->load(std::memory_order_relaxed)) {
+    return StopReason::stopped;
+  }
+  if (num_observations_ > 0 && best_value() >= target_value_) {
+    return StopReason::target;
+  }
+  if (stall_observations_ > 0 &&
+      num_observations_ - stall_start_ >= stall_observations_) {
+    return StopReason::stall;
+  }
+  if (max_seconds_ > 0.0 &&
+      elapsed_seconds() + max_batch_interval_ >= max_seconds_) {
+    return StopReason::deadline;
+  }
+  return StopReason::none;
+} /* EarlyStopReason() */
+
+/***********************************************************
+* SetStopFlag
+* Stop the run before the next batch of points once
+* 'stop_flag' is set, from any thread. A null flag removes
+* it again.
+***********************************************************/
+void OptIntf::SetStopFlag(std::shared_ptr<const std::atomic<bool>> stop_flag)
+{
+  stop_flag_ = std::move(stop_flag);
+} /* SetStopFlag() */
+
+/***********************************************************
+* SetBatchHook
+* Have 'hook' decide before every batch of points whether
+* the run should stop, on top of the options. Setting a
+* hook (or a null one, to remove it) forgets why the last
+* one stopped the run.
+***********************************************************/
+void OptIntf::SetBatchHook(BatchHook hook)
+{
+  batch_hook_ = std::move(hook);
+  hook_reason_ = StopReason::none;
+} /* SetBatchHook() */
+
+/***********************************************************
+* EvaluatePoints
+* Evaluate the objective on every row of 'points', or the
+* rung 'fidelity' of the fidelity ladder if it isn't -1.
+* The batch objective is used if there is one, otherwise
+* the points are handed to the evaluator.
+***********************************************************/
+void OptIntf::EvaluatePoints(const matrixd& points, int fidelity,
+                             vectord* values)
+{
+  const ObjectiveFn& fn = fidelity < 0 ? fn_ : fidelities_[fidelity].fn;
+  const BatchObjectiveFn& batch_fn = fidelity < 0 ? batch_fn_
+                                     : fidelities_[fidelity].batch_fn;
+  if (!batch_fn && !fn) {
+    throw std::runtime_error("No objective to evaluate; use Ask and Tell");
+  }
+
+  STATS(auto start = Stats::clock::now());
+  if (batch_fn) {
+    if (values->size() != points.size1()) {
+      values->resize(points.size1(), false);
+    }
+    batch_fn(points, values);
+    // Single evaluations can't be timed inside a batch, so count each one
+    // as taking an equal share of it
+    STATS(stats_.eval_latency()->Add(Stats::SecondsSince(start) 
+                                     / points.size1(), points.size1()));
+  } else {
+#ifdef _CPPLOGO_ENABLE_STATS
+    LatencyHistogram* latency = stats_.eval_latency();
+    ObjectiveFn timed_fn = [&fn, latency](const vectord& x) {
+      auto call_start = Stats::clock::now();
+      double value = fn(x);
+      latency->Add(Stats::SecondsSince(call_start));
+      return value;
+    };
+    evaluator_->Evaluate(timed_fn, points, values);
+#else
+    evaluator_->Evaluate(fn, points, values);
+#endif
+  }
+  STATS(stats_.AddFnTime(Stats::SecondsSince(start)));
+} /* EvaluatePoints() */
 
 /***********************************************************
 * IsFinished
 * Returns true if the optiization is finished.
 ***********************************************************/
 bool OptIntf::IsFinished() const {
-  return num_observations_ >= max_observations_;
+  return stop_reason() != StopReason::none;
 }
 
+/***********************************************************
+* stop_reason
+* Returns why the optimization is finished, or
+* StopReason::none if it isn't.
+***********************************************************/
+OptIntf::StopReason OptIntf::stop_reason() const
+{
+  if (num_observations_ >= max_observations_) {
+    return StopReason::observations;
+  }
+  return EarlyStopReason();
+} /* stop_reason() */
+
+/***********************************************************
+* elapsed_seconds
+* Wall time since the first Step/Ask.
+***********************************************************/
+double OptIntf::elapsed_seconds() const
+{
+  return clock_started_ ? Stats::SecondsSince(start_time_) : 0.0;
+} /* elapsed_seconds() */
+
+/***********************************************************
+* Save
+* Write a checkpoint of the optimizer's full state to 'os'.
+* Checkpoints can only be taken between steps.
+***********************************************************/
+void OptIntf::Save(std::ostream& os) const
+{
+  if (phase_ != StepPhase::begin || waiting_) {
+    throw std::runtime_error("Checkpoints can only be taken between steps");
+  }
+  std::string head;
+  BinaryWriter out(&head);
+  SaveState(&out);
+  std::vector<std::string> tables;
+  SaveTables(&tables);
+  WriteCheckpointHeader(os);
+  WriteCheckpointFrame(head, tables, os);
+} /* Save() */
+
+/***********************************************************
+* Load
+* Restore the state saved by Save, or by a CheckpointWriter.
+* The optimizer must have been constructed with the same
+* options as the one that was saved; everything it did so
+* far is replaced. To resume a run, construct the optimizer
+* from the checkpoint instead, which skips observing the
+* root.
+***********************************************************/
+void OptIntf::Load(std::istream& is)
+{
+  std::string head;
+  std::vector<std::string> tables;
+  {
+    std::string data((std::istreambuf_iterator<char>(is)),
+                     std::istreambuf_iterator<char>());
+    ReadCheckpoint(data, &head, &tables);
+  }
+  BinaryReader in(&head);
+  LoadState(&in);
+  if (!in.AtEnd()) {
+    throw std::runtime_error("Checkpoint doesn't match this optimizer");
+  }
+  size_t next = 0;
+  LoadTables(tables, &next);
+  if (next != tables.size()) {
+    throw std::runtime_error("Checkpoint doesn't match this optimizer");
+  }
+} /* Load() */
+
+/***********************************************************
+* SaveChanges
+* Write what a checkpoint needs to bring the one before it
+* up to date: the state that isn't kept in tables to 'head'
+* and the changes to each table since the last call to
+* 'tables'. The tables hold every record instead if
+* 'restart' is set, on the first call, and on the first
+* call after a Load; returns true if they do.
+* Checkpoints can only be taken between steps.
+***********************************************************/
+bool OptIntf::SaveChanges(std::string* head, std::vector<std::string>* tables,
+                          bool restart)
+{
+  if (phase_ != StepPhase::begin || waiting_) {
+    throw std::runtime_error("Checkpoints can only be taken between steps");
+  }
+  restart = restart || !journaling_;
+  head->clear();
+  BinaryWriter out(head);
+  SaveState(&out);
+  tables->clear();
+  JournalTables(tables, restart);
+  journaling_ = true;
+  return restart;
+} /* SaveChanges() */
+
+/***********************************************************
+* SaveState
+* Write the state held by this class. Subclasses extend this
+* with their own state.
+***********************************************************/
+void OptIntf::SaveState(BinaryWriter* out) const
+{
+  out->WriteUInt(dim_);
+  out->WriteUInt(num_observations_);
+  out->WriteUInt(num_steps_);
+  out->WriteDouble(stall_best_);
+  out->WriteUInt(stall_start_);
+} /* SaveState() */
+
+/***********************************************************
+* LoadState
+* Read back the state written by SaveState. Journaling
+* starts over with the next checkpoint.
+***********************************************************/
+void OptIntf::LoadState(BinaryReader* in)
+{
+  if (in->ReadUInt() != static_cast<uint64_t>(dim_)) {
+    throw std::runtime_error("Checkpoint dimension doesn't match");
+  }
+  num_observations_ = in->ReadUInt();
+  num_steps_ = in->ReadUInt();
+  stall_best_ = in->ReadDouble();
+  stall_start_ = in->ReadUInt();
+  phase_ = StepPhase::begin;
+  waiting_ = false;
+  journaling_ = false;
+} /* LoadState() */
+
+/***********************************************************
+* SaveTables
+* Append every record of each of the tables that hold the
+* parts of the state that grow with the run. Subclasses
+* that have such state override this, JournalTables and
+* LoadTables, and always list their tables in the same
+* order.
+***********************************************************/
+void OptIntf::SaveTables(std::vector<std::string>* tables) const
+{
+  (void)tables;
+} /* SaveTables() */
+
+/***********************************************************
+* JournalTables
+* Append the changes to each table since the last call. If
+* 'restart' is set, append every record instead (as
+* SaveTables does) and journal the changes from here on.
+***********************************************************/
+void OptIntf::JournalTables(std::vector<std::string>* tables, bool restart)
+{
+  (void)tables;
+  (void)restart;
+} /* JournalTables() */
+
+/***********************************************************
+* LoadTables
+* Read back the tables written by SaveTables, starting with
+* tables[*next] and moving 'next' past the ones used.
+* Called after LoadState.
+***********************************************************/
+void OptIntf::LoadTables(const std::vector<std::string>& tables, size_t* next)
+{
+  (void)tables;
+  (void)next;
+} /* LoadTables() */
+
+/***********************************************************
+* CollectStats
+* Fill in the counters that describe the optimizer's state
+* at the end of a step. Only called when stats are enabled.
+***********************************************************/
+void OptIntf::CollectStats(StepStats* step) const
+{
+  (void)step;
+} /* CollectStats() */
+
 }
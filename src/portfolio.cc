@@ -0,0 +1,336 @@
+#include "cpplogo/portfolio.h"
+#include "cpplogo/stats.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace cpplogo {
+
+/***********************************************************
+* Portfolio constructor
+***********************************************************/
+Portfolio::Portfolio(const Options& opt) :
+  num_threads_(opt.num_threads), max_observations_(opt.max_observations),
+  target_value_(opt.target_value), share_target_(opt.share_target),
+  members_(), queues_(), result_(), charges_(), num_observations_(0),
+  num_active_(0),
+  num_queued_(0), num_steals_(0),
+  stop_(std::make_shared<std::atomic<bool>>(false)), idle_mutex_(),
+  idle_cv_(), error_mutex_(), error_()
+{
+  if (num_threads_ == 0) {
+    num_threads_ = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+} /* Portfolio() */
+
+/***********************************************************
+* Add
+* Add an optimizer to the portfolio. Returns its index.
+***********************************************************/
+size_t Portfolio::Add(std::shared_ptr<OptIntf> member)
+{
+  members_.push_back(member);
+  return members_.size()-1;
+} /* Add() */
+
+/***********************************************************
+* Run
+* Step every member until it is finished or reaches the
+* target, or until the whole portfolio is stopped.
+* The calling thread is one of the threads doing the work.
+* If a member throws, the other members are stopped and the
+* first exception is rethrown here.
+* The members keep the portfolio's stop flag afterwards, so
+* members that were stopped stay finished until the next
+* run (or until their flag is replaced). Their batch hooks
+* are removed, so outside of a run they only go by their
+* own options.
+***********************************************************/
+const Portfolio::Result& Portfolio::Run()
+{
+  result_ = Result();
+  result_.members.resize(members_.size());
+  if (members_.empty()) {
+    return result_;
+  }
+
+  // Deal the members out to the threads
+  size_t num_threads = std::min(num_threads_, members_.size());
+  queues_.clear();
+  for (size_t t = 0; t < num_threads; t++) {
+    queues_.emplace_back(new WorkQueue());
+  }
+  for (size_t m = 0; m < members_.size(); m++) {
+    queues_[m % num_threads]->members.push_back(m);
+  }
+
+  num_observations_ = 0;
+  num_active_ = members_.size();
+  num_queued_ = members_.size();
+  num_steals_ = 0;
+  *stop_ = false;
+  error_ = nullptr;
+  charges_.assign(members_.size(), Charge());
+  for (size_t m = 0; m < members_.size(); m++) {
+    charges_[m].start_observations = members_[m]->num_observations();
+    members_[m]->SetStopFlag(stop_);
+    members_[m]->SetBatchHook([this, m](const OptIntf& alg, int num_points) {
+      return CheckBatch(m, alg, num_points);
+    });
+  }
+
+  auto start = Stats::clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < num_threads; t++) {
+    workers.emplace_back(&Portfolio::WorkerLoop, this, t);
+  }
+  WorkerLoop(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (auto& member : members_) {
+    member->SetBatchHook(OptIntf::BatchHook());
+  }
+  result_.seconds = Stats::SecondsSince(start);
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+
+  // Put the results of the members together
+  result_.num_steals = num_steals_;
+  for (size_t m = 0; m < members_.size(); m++) {
+    MemberResult& member = result_.members[m];
+    member.best_value = members_[m]->best_value();
+    result_.num_observations += member.num_observations;
+    result_.num_steps += member.num_steps;
+    result_.num_reached_target += member.reached_target;
+    if (member.best_value > result_.best_value) {
+      result_.best_value = member.best_value;
+      result_.best_member = m;
+    }
+  }
+  return result_;
+} /* Run() */
+
+/***********************************************************
+* WorkerLoop
+* Main loop of each thread. Keeps taking a step of the next
+* member in its queue (or someone else's) until every
+* member is done or the portfolio is stopped. When every
+* member left is being stepped by another thread, it sleeps
+* until one of them is queued again.
+***********************************************************/
+void Portfolio::WorkerLoop(size_t worker)
+{
+  size_t member;
+  while (!*stop_) {
+    if (!NextMember(worker, &member)) {
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      idle_cv_.wait(lock, [this]() {
+        return *stop_ || num_active_ == 0 || num_queued_ > 0;
+      });
+      if (num_active_ == 0) {
+        return;
+      }
+      continue;
+    }
+
+    bool more_steps = false;
+    try {
+      more_steps = StepMember(member);
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+      Stop();
+      return;
+    }
+
+    if (more_steps) {
+      Requeue(worker, member);
+    } else {
+      FinishMember();
+    }
+  }
+} /* WorkerLoop() */
+
+/***********************************************************
+* Requeue
+* Put a member that needs more steps back at the end of a
+* thread's queue. If the thread has other members to get
+* on with, an idle thread is woken to steal this one.
+***********************************************************/
+void Portfolio::Requeue(size_t worker, size_t member)
+{
+  size_t queue_size;
+  {
+    std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+    queues_[worker]->members.push_back(member);
+    queue_size = queues_[worker]->members.size();
+  }
+  num_queued_++;
+  if (queue_size > 1) {
+    WakeIdle(false);
+  }
+} /* Requeue() */
+
+/***********************************************************
+* FinishMember
+* Count a member as done, waking every idle thread to leave
+* once no members are left.
+***********************************************************/
+void Portfolio::FinishMember()
+{
+  if (--num_active_ == 0) {
+    WakeIdle(true);
+  }
+} /* FinishMember() */
+
+/***********************************************************
+* NextMember
+* Take the member at the front of this thread's queue, or
+* steal the one at the back of another thread's queue if
+* this one is empty. Returns false if there was nothing to
+* take.
+***********************************************************/
+bool Portfolio::NextMember(size_t worker, size_t* member)
+{
+  {
+    WorkQueue& own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.members.empty()) {
+      *member = own.members.front();
+      own.members.pop_front();
+      num_queued_--;
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues_.size(); i++) {
+    WorkQueue& victim = *queues_[(worker+i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.members.empty()) {
+      *member = victim.members.back();
+      victim.members.pop_back();
+      num_queued_--;
+      num_steals_++;
+      return true;
+    }
+  }
+  return false;
+} /* NextMember() */
+
+/***********************************************************
+* StepMember
+* Take one step of a member, unless it is already done or
+* the shared budget is spent. Returns true if the member
+* needs more steps.
+***********************************************************/
+bool Portfolio::StepMember(size_t member)
+{
+  OptIntf* alg = members_[member].get();
+  MemberResult& result = result_.members[member];
+  auto done = [&]() {
+    if (alg->best_value() >= target_value_) {
+      result.reached_target = true;
+      if (share_target_) {
+        Stop();
+      }
+      return true;
+    }
+    return alg->IsFinished();
+  };
+
+  if (done()) {
+    return false;
+  }
+  if (num_observations_ >= max_observations_) {
+    Stop();
+    return false;
+  }
+
+  int start_observations = alg->num_observations();
+  auto start = Stats::clock::now();
+  alg->Step();
+  result.seconds += Stats::SecondsSince(start);
+  result.num_steps++;
+
+  result.num_observations += alg->num_observations() - start_observations;
+  SettleCharge(member, *alg, 0);
+  return !done();
+} /* StepMember() */
+
+/***********************************************************
+* CheckBatch
+* The members' batch hook. Stops a member that has reached
+* the target (and every member, if the target is shared),
+* and charges the batch to the shared budget, stopping every
+* member instead if the budget is already spent.
+***********************************************************/
+OptIntf::StopReason Portfolio::CheckBatch(size_t member, const OptIntf& alg,
+                                          int num_points)
+{
+  if (alg.num_observations() > 0 && alg.best_value() >= target_value_) {
+    result_.members[member].reached_target = true;
+    SettleCharge(member, alg, 0);
+    if (share_target_) {
+      Stop();
+    }
+    return OptIntf::StopReason::target;
+  }
+  if (SettleCharge(member, alg, num_points) >= max_observations_) {
+    SettleCharge(member, alg, 0);
+    Stop();
+    return OptIntf::StopReason::stopped;
+  }
+  return OptIntf::StopReason::none;
+} /* CheckBatch() */
+
+/***********************************************************
+* SettleCharge
+* Bring what a member has charged to the shared budget in
+* line with the observations it has made (points that hit a
+* cache or were never evaluated are given back), then charge
+* 'num_points' more for its next batch. Returns what was
+* charged by every member before that batch.
+***********************************************************/
+int64_t Portfolio::SettleCharge(size_t member, const OptIntf& alg,
+                                int num_points)
+{
+  Charge& charge = charges_[member];
+  int64_t made = alg.num_observations() - charge.start_observations;
+  int64_t change = made + num_points - charge.charged;
+  charge.charged = made + num_points;
+  return num_observations_.fetch_add(change) + change - num_points;
+} /* SettleCharge() */
+
+/***********************************************************
+* Stop
+* Stop every member before its next batch of points, and
+* wake the idle threads to leave.
+***********************************************************/
+void Portfolio::Stop()
+{
+  *stop_ = true;
+  WakeIdle(true);
+} /* Stop() */
+
+/***********************************************************
+* WakeIdle
+* Wake one idle thread, or all of them. The mutex is taken
+* so that a thread about to sleep sees the change that
+* woke the others.
+***********************************************************/
+void Portfolio::WakeIdle(bool all)
+{
+  std::lock_guard<std::mutex> lock(idle_mutex_);
+  if (all) {
+    idle_cv_.notify_all();
+  } else {
+    idle_cv_.notify_one();
+  }
+} /* WakeIdle() */
+
+}
@@ -0,0 +1,212 @@
+#include "cpplogo/serialize.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace cpplogo {
+
+/***********************************************************
+* BinaryWriter constructor
+* Everything written is appended to 'buffer'.
+***********************************************************/
+BinaryWriter::BinaryWriter(std::string* buffer) :
+  buffer_(buffer)
+{
+} /* BinaryWriter() */
+
+/***********************************************************
+* WriteUInt
+* Write an unsigned integer, 7 bits per byte.
+***********************************************************/
+void BinaryWriter::WriteUInt(uint64_t value)
+{
+  while (value >= 0x80) {
+    buffer_->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buffer_->push_back(static_cast<char>(value));
+} /* WriteUInt() */
+
+/***********************************************************
+* WriteInt
+* Write a signed integer. Zigzag encoding keeps small
+* negative numbers small.
+***********************************************************/
+void BinaryWriter::WriteInt(int64_t value)
+{
+  WriteUInt((static_cast<uint64_t>(value) << 1) ^
+            static_cast<uint64_t>(value >> 63));
+} /* WriteInt() */
+
+/***********************************************************
+* WriteFixed
+* Write an unsigned integer as its raw 8 bytes.
+***********************************************************/
+void BinaryWriter::WriteFixed(uint64_t value)
+{
+  char bytes[sizeof(uint64_t)];
+  std::memcpy(bytes, &value, sizeof(uint64_t));
+  buffer_->append(bytes, sizeof(uint64_t));
+} /* WriteFixed() */
+
+/***********************************************************
+* WriteDouble
+***********************************************************/
+void BinaryWriter::WriteDouble(double value)
+{
+  char bytes[sizeof(double)];
+  std::memcpy(bytes, &value, sizeof(double));
+  buffer_->append(bytes, sizeof(double));
+} /* WriteDouble() */
+
+/***********************************************************
+* WriteString
+* Write a length-prefixed string of bytes.
+***********************************************************/
+void BinaryWriter::WriteString(const std::string& value)
+{
+  WriteUInt(value.size());
+  buffer_->append(value);
+} /* WriteString() */
+
+/***********************************************************
+* WriteBytes
+* Append bytes written by another BinaryWriter as they are.
+***********************************************************/
+void BinaryWriter::WriteBytes(const std::string& bytes)
+{
+  buffer_->append(bytes);
+} /* WriteBytes() */
+
+/***********************************************************
+* WriteBytes
+* Same as above, for bytes that aren't a string of their
+* own.
+***********************************************************/
+void BinaryWriter::WriteBytes(const char* bytes, size_t size)
+{
+  buffer_->append(bytes, size);
+} /* WriteBytes() */
+
+/***********************************************************
+* UIntSize
+* Number of bytes WriteUInt takes for 'value'.
+***********************************************************/
+size_t BinaryWriter::UIntSize(uint64_t value)
+{
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+} /* UIntSize() */
+
+/***********************************************************
+* BinaryReader constructor
+* Reads from the start of 'buffer'.
+***********************************************************/
+BinaryReader::BinaryReader(const std::string* buffer) :
+  buffer_(buffer), pos_(0), end_(buffer->size())
+{
+} /* BinaryReader() */
+
+/***********************************************************
+* BinaryReader constructor
+* Reads the bytes of 'buffer' from 'begin' up to 'end'.
+***********************************************************/
+BinaryReader::BinaryReader(const std::string* buffer, size_t begin,
+                           size_t end) :
+  buffer_(buffer), pos_(begin), end_(end)
+{
+  if (begin > end || end > buffer->size()) {
+    throw std::runtime_error("Bad range of checkpoint data");
+  }
+} /* BinaryReader() */
+
+/***********************************************************
+* ReadUInt
+***********************************************************/
+uint64_t BinaryReader::ReadUInt()
+{
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (pos_ >= end_) {
+      throw std::runtime_error("Unexpected end of checkpoint data");
+    }
+    uint8_t byte = static_cast<uint8_t>((*buffer_)[pos_++]);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Malformed integer in checkpoint data");
+} /* ReadUInt() */
+
+/***********************************************************
+* ReadInt
+***********************************************************/
+int64_t BinaryReader::ReadInt()
+{
+  uint64_t value = ReadUInt();
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+} /* ReadInt() */
+
+/***********************************************************
+* ReadFixed
+***********************************************************/
+uint64_t BinaryReader::ReadFixed()
+{
+  if (remaining() < sizeof(uint64_t)) {
+    throw std::runtime_error("Unexpected end of checkpoint data");
+  }
+  uint64_t value;
+  std::memcpy(&value, buffer_->data() + pos_, sizeof(uint64_t));
+  pos_ += sizeof(uint64_t);
+  return value;
+} /* ReadFixed() */
+
+/***********************************************************
+* ReadDouble
+***********************************************************/
+double BinaryReader::ReadDouble()
+{
+  if (remaining() < sizeof(double)) {
+    throw std::runtime_error("Unexpected end of checkpoint data");
+  }
+  double value;
+  std::memcpy(&value, buffer_->data() + pos_, sizeof(double));
+  pos_ += sizeof(double);
+  return value;
+} /* ReadDouble() */
+
+/***********************************************************
+* ReadString
+***********************************************************/
+std::string BinaryReader::ReadString()
+{
+  uint64_t size = ReadUInt();
+  if (remaining() < size) {
+    throw std::runtime_error("Unexpected end of checkpoint data");
+  }
+  std::string value = buffer_->substr(pos_, size);
+  pos_ += size;
+  return value;
+} /* ReadString() */
+
+/***********************************************************
+* ReadBytes
+* Step over the next 'size' bytes, returning where they
+* are in the buffer.
+***********************************************************/
+const char* BinaryReader::ReadBytes(size_t size)
+{
+  if (remaining() < size) {
+    throw std::runtime_error("Unexpected end of checkpoint data");
+  }
+  const char* bytes = buffer_->data() + pos_;
+  pos_ += size;
+  return bytes;
+} /* ReadBytes() */
+
+}
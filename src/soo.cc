@@ -2,265 +2,677 @@
 
 #include "cpplogo/logging.h"
 #include <algorithm>
+#include <cassert>
+#include <stdexcept>
 
 using std::vector;
 
 namespace cpplogo {
 
 /***********************************************************
-* SOO constructor
+* SOOBase constructor
+* When 'resuming', the root is left out, since the caller
+* is about to load a checkpoint over it.
 ***********************************************************/
-SOO::SOO(const Options& opt) :
+SOOBase::SOOBase(const Options& opt, bool resuming) :
   OptIntf(opt),
   num_children_(opt.num_children),
+  batch_steps_(opt.batch_steps),
+  max_space_bytes_(opt.max_space_bytes),
   vmax_(),
   num_expansions_(1),
   num_node_evals_(1),
+  num_low_fidelity_observations_(0),
+  prune_bytes_(max_space_bytes_),
+  num_pruned_nodes_(0),
+  arena_(dim_, num_children_),
+  best_node_(&arena_, arena_.Allocate(), 0),
+  spill_(opt.spill_dir.empty() ? nullptr
+                               : std::make_unique<SpillStore>(opt.spill_dir)),
   space_(),
-  step_observed_nodes_()
+  step_observed_nodes_(),
+  children_(),
+  expansion_queue_(),
+  expansion_depths_(),
+  pending_(),
+  promotions_(),
+  eval_nodes_(),
+  eval_points_(),
+  eval_values_(),
+  cache_misses_(),
+  pruned_(),
+  fidelity_nodes_(fidelities_.size()+1),
+  next_fidelity_(0),
+  promoting_(false)
 { 
-  // Create top-level node and observe its value
-  vectord edges(dim_), sizes(dim_);
-  for (int i = 0; i < dim_; i++) {
-    edges[i] = 0.0;
-    sizes[i] = 1.0;
+  // An odd number of children puts one child in the middle of its parent
+  assert(num_children_ % 2 == 1);
+
+  if (resuming) {
+    return;
+  }
+
+  // Create top-level node and ask for its value. It is always expanded in
+  // the first step, so it goes straight to the objective even when there
+  // is a fidelity ladder.
+  NodeArena::Handle handle = arena_.Allocate();
+  arena_.InitRoot(handle);
+  children_.emplace_back(&arena_, handle, 0);
+  pending_.push_back(&children_.back());
+  RequestFullValues(pending_);
+
+  // Observe it right away if there is an objective, so there is always a
+  // best node. Otherwise the first Ask returns it.
+  if (waiting_ && (fn_ || batch_fn_)) {
+    EvaluatePoints(ask_points_, ask_fidelity_, &tell_values_);
+    Tell(tell_values_);
+  } else if (!waiting_) {
+    MoveChildrenIntoSpace();
   }
-  space_.emplace_back();
-  space_[0].emplace_back(edges, sizes, 0);
-  ObserveNode(&space_[0].back());
-} /* SOO() */
+} /* SOOBase() */
 
 /***********************************************************
 * BeginStep
 * Called at the beginning of each optimization step.
 ***********************************************************/
-void SOO::BeginStep() 
+void SOOBase::BeginStep() 
 {
   LOG(trace) << "Beginning step";
   vmax_ = -std::numeric_limits<double>::infinity();
   step_observed_nodes_.clear();
+  // Nothing refers to the nodes removed last step anymore, so their
+  // geometry can be reused
+  arena_.Recycle();
 } /* BeginStep() */
 
 /***********************************************************
-* EndStep
-* Called at the end of each optimization step.
-***********************************************************/
-void SOO::EndStep()
-{
-  LOG(trace) << "Ending step";
-} /* EndStep() */
-
-/***********************************************************
-* CalculateMaxDepth
-* TODO: This should probably return a size_t
+* BaseMaxDepth
+* The deepest level SOO expands from in this step. Depth set
+* policies derive their own limit from this.
 ***********************************************************/
-size_t SOO::CalculateMaxDepth() const
+size_t SOOBase::BaseMaxDepth() const
 {
   size_t max_depth = std::sqrt(num_expansions_);
   max_depth = std::min(max_depth, space_.size());
   LOG(trace) << "Max depth = " << max_depth;
   return max_depth;
-} /* CalculateMaxDepth() */
+} /* BaseMaxDepth() */
 
 /***********************************************************
-* ExpandBestAtDepth
-* Expand the node with the best value at the specified
-* depth.
+* QueueExpansion
+* Queue the best node of a depth set for expansion if it is
+* better than every node expanded so far in this step.
+* Returns true if it was queued.
 ***********************************************************/
-void SOO::ExpandBestAtDepth(size_t depth)
+bool SOOBase::QueueExpansion(Node* node)
 {
-  LOG(trace) << "Expanding depth " << depth;
-  // Find the best node
-  Node* best_node = BestNodeAtDepth(depth);
-  if (!best_node) {
-    LOG(trace) << "Depth empty";
-    return;
+  num_node_evals_ += 1;
+  if (node->value() > vmax_) {
+    vmax_ = node->value();
+    LOG(trace) << "New vmax = " << vmax_;
+    expansion_queue_.push_back(node);
+    num_expansions_ += 1;
+    return true;
   }
-  LOG(trace) << "Best node = " << *best_node;
+  return false;
+} /* QueueExpansion() */
 
-  // Expand the node and evaluate its children if the best node is good enough
-  if (best_node->value() > vmax_) {
-    vmax_ = best_node->value();
-    LOG(trace) << "New vmax = " << vmax_;
+/***********************************************************
+* LiveSpaceBytes
+* Memory taken up by the nodes in the space, not counting
+* spare capacity.
+***********************************************************/
+size_t SOOBase::LiveSpaceBytes() const
+{
+  size_t num_nodes = 0;
+  for (const auto& level : space_) {
+    num_nodes += level.size();
+  }
+  return num_nodes * (dim_*arena_.code_bytes() + DepthLevel::node_bytes());
+} /* LiveSpaceBytes() */
 
-    // Get the resultant children from the expansion
-    vector<Node> children = ExpandNode(best_node);
-    num_expansions_ += 1; 
-    // Make observations for each un-observed node among the children
-    ObserveNodes(&children);
+/***********************************************************
+* BestPoint
+* Returns the best point observed so far, in the domain of
+* the objective.
+***********************************************************/
+vectord SOOBase::BestPoint() const
+{
+  vectord point(dim_);
+  for (int d = 0; d < dim_; d++) {
+    point(d) = domain_.Map(d, best_node_.center(d));
+  }
+  return point;
+} /* BestPoint() */
 
-    // Make sure we have a place to put the next level of nodes
-    int next_depth = best_node->depth()+1;
-    if (space_.size() <= static_cast<size_t>(next_depth)) {
-      space_.resize(next_depth+1);
-    }
+/***********************************************************
+* num_spilled_nodes
+* Number of nodes in the space that are spilled to disk.
+***********************************************************/
+size_t SOOBase::num_spilled_nodes() const
+{
+  size_t num_spilled = 0;
+  for (const auto& level : space_) {
+    num_spilled += level.num_spilled();
+  }
+  return num_spilled;
+} /* num_spilled_nodes() */
 
-    // Put the expanded nodes into the appropriate level in the space
-    auto& next_level = space_[next_depth];
-    next_level.insert(next_level.end(), children.begin(), children.end());
+/***********************************************************
+* NeedsPruning
+* Returns true if there is a limit on the size of the space
+* and the space has grown past the point where it should be
+* pruned.
+***********************************************************/
+bool SOOBase::NeedsPruning() const
+{
+  return max_space_bytes_ > 0 && LiveSpaceBytes() > prune_bytes_;
+} /* NeedsPruning() */
 
-    // Delete the node that was expanded
-    RemoveNode(best_node);
+/***********************************************************
+* MaxRemainingExpansions
+* Upper bound on the number of expansions left in the run,
+* counting the step that is about to begin, assuming steps
+* are only started while IsFinished() is false and every
+* expansion observes all of its children but the center one.
+* Only E_b = ceil(remaining observations / (num_children-1))
+* expansions fit in the steps before the last one, and the
+* last one makes at most one expansion per depth, i.e. at
+* most sqrt(num_expansions + E)+1. Solving
+* E <= E_b + 1 + sqrt(num_expansions + E) for E gives the
+* bound.
+***********************************************************/
+size_t SOOBase::MaxRemainingExpansions() const
+{
+  if (num_children_ < 2) {
+    return std::numeric_limits<size_t>::max();
   }
-  num_node_evals_ += 1;
-} /* ExpandBestAtDepth() */
+  int64_t remaining = std::max<int64_t>(
+    static_cast<int64_t>(max_observations_) - num_observations_, 0);
+  size_t before_last = (remaining + num_children_-2) / (num_children_-1);
+  return before_last + 2
+         + static_cast<size_t>(std::sqrt(static_cast<double>(num_expansions_)
+                                         + before_last + 1));
+} /* MaxRemainingExpansions() */
 
 /***********************************************************
-* BestNodeAtDepth
-* Find the node with the best value at the specified depth
-* level.
-* Returns a pointer to that node. Returns a null pointer
-* if no nodes exist at the requested depth.
+* PruneSpace
+* Drop the nodes that can never be expanded in the rest of
+* the run:
+*  - every node deeper than 'deepest_depth', the deepest
+*    depth the depth set policy can expand from, and
+*  - every node with at least 'max_expansions' better nodes
+*    at its own depth. Nodes only leave a depth by being
+*    expanded, and a depth's best node is always expanded
+*    first, so all of the better nodes would have to be
+*    expanded before it.
+* Neither kind of node can ever be chosen, so the search
+* makes exactly the same decisions as without pruning.
+* Empty depths are kept, since the number of depths limits
+* the maximum depth.
+* If that isn't enough to get under the limit, nodes are
+* spilled to disk, when there is somewhere to spill them.
 ***********************************************************/
-const Node* SOO::BestNodeAtDepth(size_t depth) const
+void SOOBase::PruneSpace(size_t max_expansions, size_t deepest_depth)
 {
-  // If the depth doesn't exist, it can't have a best node
-  if (depth >= space_.size()) return nullptr;
-  const vector<Node>& nodes = space_.at(depth);
-  const Node* best_node = nullptr;
+  pruned_.clear();
+  for (size_t depth = 0; depth < space_.size(); depth++) {
+    space_[depth].Prune(depth > deepest_depth ? 0 : max_expansions, &pruned_);
+  }
+  for (NodeArena::Handle handle : pruned_) {
+    arena_.Retire(handle);
+  }
+  num_pruned_nodes_ += pruned_.size();
+  LOG(debug) << "Pruned " << pruned_.size() << " nodes";
+
+  // Spill down to half the limit, so there is room to grow before the next
+  // spill
+  size_t live_bytes = LiveSpaceBytes();
+  if (live_bytes > max_space_bytes_ && spill_) {
+    SpillSpace(max_space_bytes_/2);
+    live_bytes = LiveSpaceBytes();
+  }
 
-  // Node comparison lambda function
-  // See the max_element STL documentation
-  auto node_comp = [](const Node& a, const Node& b) { 
-    return a.value() < b.value(); 
-  };
-  auto best_it = std::max_element(nodes.begin(), nodes.end(), node_comp);
+  // If the space is still too big, wait for it to grow some more before
+  // trying again, so pruning doesn't run on every step
+  prune_bytes_ = std::max(max_space_bytes_, live_bytes + live_bytes/4);
+} /* PruneSpace() */
 
-  // If we found a node, set the best_node pointer to the address of
-  // the best node found
-  // Otherwise, no nodes are at this depth and best_node will be null
-  if (best_it != nodes.end()) {
-    best_node = &(*best_it);
+/***********************************************************
+* SpillSpace
+* Spill the worst nodes of the biggest depths to disk, until
+* the nodes left in memory take at most 'max_bytes'. Every
+* depth keeps at least its best node in memory.
+***********************************************************/
+void SOOBase::SpillSpace(size_t max_bytes)
+{
+  size_t max_nodes = max_bytes
+                     / (dim_*arena_.code_bytes() + DepthLevel::node_bytes());
+
+  // Find the largest number of nodes per depth that fits
+  size_t lo = 1;
+  size_t hi = 1;
+  for (const auto& level : space_) {
+    hi = std::max(hi, level.size());
+  }
+  while (lo < hi) {
+    size_t mid = lo + (hi-lo+1)/2;
+    size_t num_nodes = 0;
+    for (const auto& level : space_) {
+      num_nodes += std::min(level.size(), mid);
+    }
+    if (num_nodes <= max_nodes) {
+      lo = mid;
+    } else {
+      hi = mid-1;
+    }
   }
 
-  return best_node;
-} /* BestNodeAtDepth() */
+  pruned_.clear();
+  for (auto& level : space_) {
+    level.Spill(lo, spill_.get(), &pruned_);
+  }
+  for (NodeArena::Handle handle : pruned_) {
+    arena_.Retire(handle);
+  }
+  LOG(debug) << "Spilled " << pruned_.size() << " nodes, keeping up to "
+             << lo << " per depth";
+} /* SpillSpace() */
 
 /***********************************************************
-* BestNodeAtDepth
-* Do some fancy casting to return a non-const pointer to the
-* best node at the requested depth.
+* GrowSpace
+* Add empty levels to the space until it has 'num_levels'.
+* If checkpoints are being journaled, so are the new levels.
 ***********************************************************/
-Node* SOO::BestNodeAtDepth(size_t depth) 
+void SOOBase::GrowSpace(size_t num_levels)
 {
-  const auto cthis = const_cast<const SOO*>(this);
-  return const_cast<Node*>(cthis->BestNodeAtDepth(depth));
-} /* BestNodeAtDepth() */
+  std::string records;
+  while (space_.size() < num_levels) {
+    space_.emplace_back();
+    if (journaling_) {
+      space_.back().StartJournal(&records);
+    }
+  }
+} /* GrowSpace() */
 
 /***********************************************************
-* BestNode
-* Returns a pointer to the best node in the entire space.
-* TODO: This should probably leverage BestNodeAtDepth
+* MoveChildrenIntoSpace
+* Replace every queued node with its children, which have
+* been observed and are waiting in children_.
+* The root is observed before the space has any levels, and
+* goes into level 0.
 ***********************************************************/
-const Node* SOO::BestNode() const
+void SOOBase::MoveChildrenIntoSpace()
 {
-  const Node* best_node = nullptr;
-  for (const auto& nodes : space_) {
-    for (const auto& n : nodes) {
-      if (best_node == nullptr || n.value() > best_node->value()) {
-        best_node = &n;
-      }
+  if (space_.empty()) {
+    GrowSpace(1);
+    space_[0].Insert(children_[0]);
+    return;
+  }
+
+  // Delete the nodes that were expanded. This has to happen before any
+  // children are inserted, since inserting into a level can move the
+  // queued node that lives there.
+  expansion_depths_.clear();
+  for (Node* node : expansion_queue_) {
+    expansion_depths_.push_back(node->depth());
+    RemoveNode(node);
+  }
+  expansion_queue_.clear();
+
+  // Put the expanded nodes into the appropriate level in the space
+  auto child = children_.begin();
+  for (int depth : expansion_depths_) {
+    // Make sure we have a place to put the next level of nodes
+    size_t next_depth = depth+1;
+    GrowSpace(next_depth+1);
+    auto& next_level = space_[next_depth];
+    for (int i = 0; i < num_children_; i++) {
+      next_level.Insert(*child++);
+    }
+  }
+
+  // Bring spilled nodes back to depths whose best node may be one of them
+  for (int depth : expansion_depths_) {
+    if (space_[depth].NeedsReload()) {
+      LOG(trace) << "Reloading depth " << depth;
+      space_[depth].Reload(&arena_);
     }
   }
-  return best_node;
-} /* BestNode() */
+} /* MoveChildrenIntoSpace() */
 
 /***********************************************************
 * RemoveNode
 * Remove the specified node from the node space.
+* Copies of the node stay readable until the next step
+* begins.
 ***********************************************************/
-void SOO::RemoveNode(Node* node)
+void SOOBase::RemoveNode(Node* node)
 {
-  // Get a reference to the depth the node is at
-  auto& depth_list = space_[node->depth()];
-
-  // Use fancy STL stuff to find the iterator to the node in its depth
-  auto pred = [node](const Node& n) { return &n == node; };
-  auto it = std::find_if(depth_list.begin(), depth_list.end(), pred);
-  assert(it != depth_list.end());
-
-  depth_list.erase(it);
+  arena_.Retire(node->handle());
+  space_[node->depth()].Remove(node);
 } /* RemoveNode() */
 
 /***********************************************************
-* ExpandNode
-* Expand the specified node.
-* Returns a list of the resultant child nodes.
+* IsExpandable
+* Returns false if the node's cell can't be split any
+* further along the dimensions split the fewest times,
+* which are the only ones the split policies choose from.
+* Only nodes deeper than dim*max_splits can get there.
 ***********************************************************/
-vector<Node> SOO::ExpandNode(const Node* node) const
+bool SOOBase::IsExpandable(const Node* node) const
 {
-  LOG(trace) << "Expanding " << *node;
-  vector<Node> children;
+  const int max_splits = arena_.max_splits();
+  if (node->depth() < dim_*max_splits) {
+    return true;
+  }
+  for (int d = 0; d < dim_; d++) {
+    if (node->splits(d) < max_splits) {
+      return true;
+    }
+  }
+  return false;
+} /* IsExpandable() */
 
-  //Choose which dimension to split along
-  size_t split_dim = ChooseSplitDimension(node);
+/***********************************************************
+* DropUnexpandable
+* Remove a node that can never be expanded from the space,
+* like pruning does. Its value is already accounted for in
+* the best node, and the level is reloaded if the node was
+* hiding spilled ones.
+***********************************************************/
+void SOOBase::DropUnexpandable(Node* node)
+{
+  LOG(debug) << "Dropping " << *node << ", split as finely as it can be";
+  size_t depth = node->depth();
+  RemoveNode(node);
+  num_pruned_nodes_++;
+  if (space_[depth].NeedsReload()) {
+    space_[depth].Reload(&arena_);
+  }
+} /* DropUnexpandable() */
 
-  //Calculate new values for child nodes
-  vectord edges = node->edges();
-  vectord sizes = node->sizes();
+/***********************************************************
+* SplitNode
+* Split the specified node along 'split_dim'.
+* Appends the resultant child nodes to 'children'.
+***********************************************************/
+void SOOBase::SplitNode(const Node* node, size_t split_dim,
+                        vector<Node>* children)
+{
+  //Create child nodes, each covering one slice of the split dimension
   int depth = node->depth()+1;
-  double new_size = sizes[split_dim]/num_children_;
-  sizes[split_dim] = new_size;
-
-  //Create child nodes
   for (int i = 0; i < num_children_; i++) {
-    children.emplace_back(edges, sizes, depth);
-    edges[split_dim] += new_size;
+    NodeArena::Handle handle = arena_.Allocate();
+    arena_.CopyGeometry(node->handle(), handle);
+    arena_.Split(handle, split_dim, i);
+    children->emplace_back(&arena_, handle, depth);
 
     // ...the center child node can just take its value from its parent!
-    assert(num_children_ % 2 == 1);
     if (i == num_children_/2 && !node->is_fake_value()) {
-      children.back().SetValue(node->value());
+      children->back().SetValue(node->value());
+    }
+  }
+} /* SplitNode() */
+
+/***********************************************************
+* MapCenters
+* Put the center of each node in 'nodes', mapped into the
+* domain, into a row of 'points'.
+***********************************************************/
+void SOOBase::MapCenters(const vector<Node*>& nodes, matrixd* points) const
+{
+  if (points->size1() != nodes.size()) {
+    points->resize(nodes.size(), dim_, false);
+  }
+  for (size_t i = 0; i < nodes.size(); i++) {
+    for (int d = 0; d < dim_; d++) {
+      (*points)(i, d) = domain_.Map(d, nodes[i]->center(d));
+    }
+  }
+} /* MapCenters() */
+
+/***********************************************************
+* ChooseFidelity
+* Returns the first rung of the fidelity ladder whose rule
+* covers the node, or -1 if it needs the objective itself.
+***********************************************************/
+int SOOBase::ChooseFidelity(const Node* node) const
+{
+  double max_size = 0.0;
+  for (int d = 0; d < dim_; d++) {
+    max_size = std::max(max_size, node->size(d));
+  }
+  for (size_t f = 0; f < fidelities_.size(); f++) {
+    if (node->depth() <= fidelities_[f].max_depth &&
+        max_size >= fidelities_[f].min_size) {
+      return f;
     }
   }
-  return children;
-} /* ExpandNode() */
+  return -1;
+} /* ChooseFidelity() */
+
+/***********************************************************
+* RequestValues
+* Ask for the values of the centers of all the nodes in
+* 'nodes'. With a fidelity ladder, the nodes are asked for
+* one rung at a time, cheapest first, and the nodes no rung
+* covers are asked for last.
+***********************************************************/
+void SOOBase::RequestValues(const vector<Node*>& nodes)
+{
+  if (fidelities_.empty()) {
+    RequestFullValues(nodes);
+    return;
+  }
+
+  for (auto& fidelity_nodes : fidelity_nodes_) {
+    fidelity_nodes.clear();
+  }
+  for (Node* node : nodes) {
+    int fidelity = ChooseFidelity(node);
+    fidelity_nodes_[fidelity < 0 ? fidelities_.size()
+                                 : static_cast<size_t>(fidelity)]
+      .push_back(node);
+  }
+  next_fidelity_ = 0;
+  RequestNextFidelity();
+} /* RequestValues() */
 
 /***********************************************************
-* ChooseSplitDimension
-* Return which dimension the specified node should be split
-* along.
-* Effectively returns the first dimension with the maximum
-* size.
+* RequestNextFidelity
+* Ask for the values of the next non-empty entry of
+* fidelity_nodes_, if there is one. Low fidelity values are
+* never cached, since the cache holds values of the
+* objective.
 ***********************************************************/
-size_t SOO::ChooseSplitDimension(const Node* node) const
+void SOOBase::RequestNextFidelity()
 {
-  size_t max_dim = 0;
-  for (size_t d = 0; d < static_cast<size_t>(dim_); d++) {
-    if (node->sizes()[d] > node->sizes()[max_dim]) {
-      max_dim = d;
+  while (!waiting_ && next_fidelity_ < fidelity_nodes_.size()) {
+    size_t fidelity = next_fidelity_++;
+    const vector<Node*>& nodes = fidelity_nodes_[fidelity];
+    if (nodes.empty()) {
+      continue;
+    }
+    if (fidelity == fidelities_.size()) {
+      RequestFullValues(nodes);
+    } else {
+      eval_nodes_.assign(nodes.begin(), nodes.end());
+      MapCenters(nodes, &ask_points_);
+      ask_fidelity_ = fidelity;
+      waiting_ = true;
     }
   }
-  LOG(trace) << "Splitting along " << max_dim;
-  return max_dim;
-} /* ChooseSplitDimension() */
+} /* RequestNextFidelity() */
 
 /***********************************************************
-* ObserveNodes
-* Observe values for each node in a list of nodes.
+* RequestFullValues
+* Ask for the values of the objective at the centers of all
+* the nodes in 'nodes'.
+* Values found in the cache are recorded right away; only
+* the rest of the points are asked for. Cache hits still
+* count as observations, so the search is the same with or
+* without a cache.
 ***********************************************************/
-void SOO::ObserveNodes(vector<Node>* nodes)
+void SOOBase::RequestFullValues(const vector<Node*>& nodes)
 {
-  for (auto& node : *nodes) {
-    ObserveNode(&node);
+  if (nodes.empty()) {
+    return;
+  }
+  eval_nodes_.assign(nodes.begin(), nodes.end());
+  ask_fidelity_ = -1;
+
+  if (!cache_) {
+    MapCenters(nodes, &ask_points_);
+    waiting_ = true;
+    return;
+  }
+
+  MapCenters(nodes, &eval_points_);
+  if (eval_values_.size() != nodes.size()) {
+    eval_values_.resize(nodes.size(), false);
   }
-} /* ObserveNodes() */
+
+  // Look everything up, and gather the misses into their own batch
+  cache_->Refresh();
+  cache_misses_.clear();
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (!cache_->Lookup(&eval_points_(i, 0), &eval_values_[i])) {
+      cache_misses_.push_back(i);
+    }
+  }
+  if (cache_misses_.empty()) {
+    if (trace_) {
+      tell_nanoseconds_ = trace_->Now();
+    }
+    for (size_t i = 0; i < eval_nodes_.size(); i++) {
+      RecordObservation(eval_nodes_[i], eval_values_[i]);
+    }
+    return;
+  }
+  if (ask_points_.size1() != cache_misses_.size()) {
+    ask_points_.resize(cache_misses_.size(), dim_, false);
+  }
+  for (size_t m = 0; m < cache_misses_.size(); m++) {
+    for (int d = 0; d < dim_; d++) {
+      ask_points_(m, d) = eval_points_(cache_misses_[m], d);
+    }
+  }
+  waiting_ = true;
+} /* RequestFullValues() */
 
 /***********************************************************
-* ObserveNode
-* Observe a value for the specified node.
+* ReceiveValues
+* Record the values of the points that were asked for, and
+* once every rung of the fidelity ladder has been told,
+* move the nodes they belong to into the space (or finish
+* promoting the node that was asked for).
 ***********************************************************/
-void SOO::ObserveNode(Node* node)
+void SOOBase::ReceiveValues(const vectord& values)
 {
-  // If the node already has a value, then we don't have to 
-  // do anything.
-  if (node->has_value()) {
-    LOG(trace) << "Already had: " << *node;
+  if (ask_fidelity_ >= 0) {
+    for (size_t i = 0; i < eval_nodes_.size(); i++) {
+      RecordLowFidelityObservation(eval_nodes_[i], values[i]);
+    }
+  } else if (!cache_) {
+    for (size_t i = 0; i < eval_nodes_.size(); i++) {
+      RecordObservation(eval_nodes_[i], values[i]);
+    }
+  } else {
+    for (size_t m = 0; m < cache_misses_.size(); m++) {
+      eval_values_[cache_misses_[m]] = values[m];
+      cache_->Insert(&ask_points_(m, 0), values[m]);
+    }
+    for (size_t i = 0; i < eval_nodes_.size(); i++) {
+      RecordObservation(eval_nodes_[i], eval_values_[i]);
+    }
+  }
+
+  RequestNextFidelity();
+  if (waiting_) {
     return;
   }
+  if (promoting_) {
+    FinishPromotion();
+  } else {
+    MoveChildrenIntoSpace();
+  }
+} /* ReceiveValues() */
+
+/***********************************************************
+* PromoteNodes
+* Ask for the real values of nodes in the space that only
+* have low fidelity values, as one batch. The nodes must be
+* in different levels. They are moved to their new places
+* in their levels once the values have been told.
+***********************************************************/
+void SOOBase::PromoteNodes(const vector<Node*>& nodes)
+{
+  for (auto& fidelity_nodes : fidelity_nodes_) {
+    fidelity_nodes.clear();
+  }
+  for (Node* node : nodes) {
+    LOG(trace) << "Promoting " << *node;
+    fidelity_nodes_.back().push_back(node);
+  }
+  next_fidelity_ = 0;
+  promoting_ = true;
+  RequestNextFidelity();
+  if (!waiting_) {
+    FinishPromotion();
+  }
+} /* PromoteNodes() */
+
+/***********************************************************
+* FinishPromotion
+* Move the nodes that were promoted to their new places in
+* their levels. If a value went down, a spilled node may now
+* be the best of its level. The levels are only reloaded
+* once every node has been moved, since reloading a level
+* can move its nodes.
+***********************************************************/
+void SOOBase::FinishPromotion()
+{
+  promoting_ = false;
+  const vector<Node*>& nodes = fidelity_nodes_.back();
+  for (const Node* node : nodes) {
+    space_[node->depth()].Update(node);
+  }
+  for (const Node* node : nodes) {
+    DepthLevel& level = space_[node->depth()];
+    if (level.NeedsReload()) {
+      level.Reload(&arena_);
+    }
+  }
+} /* FinishPromotion() */
+
+/***********************************************************
+* RecordLowFidelityObservation
+* Give the node a value from the fidelity ladder. These
+* don't count towards the budget, aren't candidates for the
+* best observation and aren't shown to the policies, but
+* they are traced.
+***********************************************************/
+void SOOBase::RecordLowFidelityObservation(Node* node, double value)
+{
+  num_low_fidelity_observations_++;
+  node->SetLowFidelityValue(value);
+  LOG(trace) << "Observed at fidelity " << ask_fidelity_ << ": " << *node;
+  if (trace_) {
+    trace_->Record(tell_nanoseconds_, num_steps_, node->depth(), value,
+                   [this, node](size_t d) {
+                     return domain_.Map(d, node->center(d));
+                   }, ask_fidelity_+1);
+  }
+} /* RecordLowFidelityObservation() */
 
-  // Observe the value and set it
-  double value = fn_(node->Center());
+/***********************************************************
+* RecordObservation
+* Give the node its observed value and keep track of the
+* observation.
+***********************************************************/
+void SOOBase::RecordObservation(Node* node, double value)
+{
   num_observations_++;
   node->SetValue(value);
 
@@ -268,6 +680,140 @@ void SOO::ObserveNode(Node* node)
   // get deleted in a future expansion during this step!
   step_observed_nodes_.push_back(*node);
   LOG(trace) << "Observed: " << *node;
-} /* ObserveNode() */
+  if (trace_) {
+    trace_->Record(tell_nanoseconds_, num_steps_, node->depth(), value,
+                   [this, node](size_t d) {
+                     return domain_.Map(d, node->center(d));
+                   });
+  }
+
+  // Keep a copy of the best observation in a slot of its own, so it
+  // survives the expansion of its node
+  if (!best_node_.has_value() || value > best_node_.value()) {
+    arena_.CopyGeometry(node->handle(), best_node_.handle());
+    best_node_ = Node(&arena_, best_node_.handle(), node->depth());
+    best_node_.SetValue(value);
+  }
+} /* RecordObservation() */
+
+/***********************************************************
+* SaveState
+* Write the counters and the shape of the node space. The
+* nodes themselves are in tables, one per level.
+***********************************************************/
+void SOOBase::SaveState(BinaryWriter* out) const
+{
+  assert(expansion_queue_.empty());
+  OptIntf::SaveState(out);
+  out->WriteUInt(num_children_);
+  out->WriteDouble(vmax_);
+  out->WriteUInt(num_expansions_);
+  out->WriteUInt(num_node_evals_);
+  out->WriteUInt(num_low_fidelity_observations_);
+  out->WriteUInt(space_.size());
+  for (const auto& level : space_) {
+    level.Save(out);
+  }
+  out->WriteUInt(step_observed_nodes_.size());
+  for (const auto& node : step_observed_nodes_) {
+    node.Save(out);
+  }
+  best_node_.Save(out);
+} /* SaveState() */
+
+/***********************************************************
+* LoadState
+* Start rebuilding the node space from a checkpoint, with
+* empty levels that LoadTables fills.
+***********************************************************/
+void SOOBase::LoadState(BinaryReader* in)
+{
+  OptIntf::LoadState(in);
+  if (in->ReadUInt() != static_cast<uint64_t>(num_children_)) {
+    throw std::runtime_error("Checkpoint number of children doesn't match");
+  }
+  vmax_ = in->ReadDouble();
+  next_fidelity_ = fidelity_nodes_.size();
+  promoting_ = false;
+  num_expansions_ = in->ReadUInt();
+  num_node_evals_ = in->ReadUInt();
+  num_low_fidelity_observations_ = in->ReadUInt();
+
+  arena_ = NodeArena(dim_, num_children_);
+  space_.clear();
+  if (spill_) {
+    spill_->Clear();
+  }
+  space_.resize(in->ReadUInt());
+  for (auto& level : space_) {
+    level.Load(in);
+  }
+
+  // These are copies of nodes that may not be in the space anymore, so
+  // their slots get recycled when the next step begins
+  step_observed_nodes_.clear();
+  uint64_t num_observed = in->ReadUInt();
+  for (uint64_t i = 0; i < num_observed; i++) {
+    step_observed_nodes_.push_back(Node::Load(in, &arena_));
+    arena_.Retire(step_observed_nodes_.back().handle());
+  }
+  best_node_ = Node::Load(in, &arena_);
+} /* LoadState() */
+
+/***********************************************************
+* SaveTables
+* Each level of the space is a table of its nodes.
+***********************************************************/
+void SOOBase::SaveTables(std::vector<std::string>* tables) const
+{
+  for (const auto& level : space_) {
+    tables->emplace_back();
+    level.SaveTable(&tables->back());
+  }
+} /* SaveTables() */
+
+/***********************************************************
+* JournalTables
+***********************************************************/
+void SOOBase::JournalTables(std::vector<std::string>* tables, bool restart)
+{
+  for (auto& level : space_) {
+    tables->emplace_back();
+    if (restart) {
+      level.StartJournal(&tables->back());
+    } else {
+      level.TakeChanges(&tables->back());
+    }
+  }
+} /* JournalTables() */
+
+/***********************************************************
+* LoadTables
+***********************************************************/
+void SOOBase::LoadTables(const std::vector<std::string>& tables, size_t* next)
+{
+  if (tables.size() - *next < space_.size()) {
+    throw std::runtime_error("Checkpoint doesn't match this optimizer");
+  }
+  for (auto& level : space_) {
+    level.LoadTable(tables[(*next)++], &arena_);
+  }
+} /* LoadTables() */
+
+/***********************************************************
+* CollectStats
+* Record the shape and size of the node space.
+***********************************************************/
+void SOOBase::CollectStats(StepStats* step) const
+{
+  step->nodes_per_depth.resize(space_.size());
+  step->live_nodes = 0;
+  step->space_bytes = arena_.num_bytes() + space_.capacity()*sizeof(DepthLevel);
+  for (size_t depth = 0; depth < space_.size(); depth++) {
+    step->nodes_per_depth[depth] = space_[depth].size();
+    step->live_nodes += space_[depth].size();
+    step->space_bytes += space_[depth].num_bytes();
+  }
+} /* CollectStats() */
 
 }
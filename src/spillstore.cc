@@ -0,0 +1,175 @@
+#include "cpplogo/spillstore.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace cpplogo {
+
+namespace {
+
+std::string ErrnoMessage(const char* what)
+{
+  return std::string(what) + ": " + std::strerror(errno);
+}
+
+}
+
+/***********************************************************
+* SpillStore constructor
+* Create the scratch file in 'dir'.
+***********************************************************/
+SpillStore::SpillStore(const std::string& dir) :
+  fd_(-1), end_(0), live_bytes_(0), free_by_offset_(), free_by_size_()
+{
+  std::string path = dir + "/cpplogo-spill-XXXXXX";
+  fd_ = mkstemp(&path[0]);
+  if (fd_ < 0) {
+    throw std::runtime_error(ErrnoMessage("Couldn't create spill file"));
+  }
+  unlink(path.c_str());
+} /* SpillStore() */
+
+/***********************************************************
+* SpillStore destructor
+***********************************************************/
+SpillStore::~SpillStore()
+{
+  close(fd_);
+} /* ~SpillStore() */
+
+/***********************************************************
+* Write
+* Write a block to the file, reusing released space where
+* it fits.
+***********************************************************/
+SpillStore::Block SpillStore::Write(const std::string& data)
+{
+  Block block = {Allocate(data.size()), data.size()};
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = pwrite(fd_, data.data()+written, data.size()-written,
+                       block.offset+written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error(ErrnoMessage("Couldn't write spill file"));
+    }
+    written += n;
+  }
+  live_bytes_ += block.size;
+  return block;
+} /* Write() */
+
+/***********************************************************
+* Read
+* Read a block back into 'data'.
+***********************************************************/
+void SpillStore::Read(const Block& block, std::string* data) const
+{
+  data->resize(block.size);
+  size_t read = 0;
+  while (read < block.size) {
+    ssize_t n = pread(fd_, &(*data)[read], block.size-read,
+                      block.offset+read);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      throw std::runtime_error(ErrnoMessage("Couldn't read spill file"));
+    }
+    read += n;
+  }
+} /* Read() */
+
+/***********************************************************
+* Release
+* Mark a block as no longer needed, so its space can be
+* reused.
+***********************************************************/
+void SpillStore::Release(const Block& block)
+{
+  live_bytes_ -= block.size;
+  if (live_bytes_ == 0) {
+    Clear();
+  } else {
+    Free(block.offset, block.size);
+  }
+} /* Release() */
+
+/***********************************************************
+* Clear
+* Release every block and give the disk space back.
+***********************************************************/
+void SpillStore::Clear()
+{
+  end_ = 0;
+  live_bytes_ = 0;
+  free_by_offset_.clear();
+  free_by_size_.clear();
+  if (ftruncate(fd_, 0) != 0) {
+    throw std::runtime_error(ErrnoMessage("Couldn't truncate spill file"));
+  }
+} /* Clear() */
+
+/***********************************************************
+* Allocate
+* Find room for a block of 'size' bytes: the start of the
+* smallest free range it fits in, with the rest of the range
+* left free, or the end of the file.
+***********************************************************/
+uint64_t SpillStore::Allocate(uint64_t size)
+{
+  auto it = free_by_size_.lower_bound(std::make_pair(size, uint64_t(0)));
+  if (it == free_by_size_.end()) {
+    uint64_t offset = end_;
+    end_ += size;
+    return offset;
+  }
+  uint64_t free_size = it->first;
+  uint64_t offset = it->second;
+  free_by_size_.erase(it);
+  free_by_offset_.erase(offset);
+  if (free_size > size) {
+    free_by_offset_[offset + size] = free_size - size;
+    free_by_size_.emplace(free_size - size, offset + size);
+  }
+  return offset;
+} /* Allocate() */
+
+/***********************************************************
+* Free
+* Add a range to the free ranges, merging it with the ones
+* next to it. A range that reaches the end of the file is
+* cut off it instead.
+***********************************************************/
+void SpillStore::Free(uint64_t offset, uint64_t size)
+{
+  auto next = free_by_offset_.lower_bound(offset);
+  if (next != free_by_offset_.end() && offset + size == next->first) {
+    size += next->second;
+    free_by_size_.erase(std::make_pair(next->second, next->first));
+    next = free_by_offset_.erase(next);
+  }
+  if (next != free_by_offset_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      free_by_size_.erase(std::make_pair(prev->second, prev->first));
+      free_by_offset_.erase(prev);
+    }
+  }
+
+  if (offset + size == end_) {
+    end_ = offset;
+    if (ftruncate(fd_, end_) != 0) {
+      throw std::runtime_error(ErrnoMessage("Couldn't truncate spill file"));
+    }
+    return;
+  }
+  free_by_offset_[offset] = size;
+  free_by_size_.emplace(size, offset);
+} /* Free() */
+
+}
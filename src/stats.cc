@@ -0,0 +1,157 @@
+#include "cpplogo/stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace cpplogo {
+
+/***********************************************************
+* LatencyHistogram constructor
+***********************************************************/
+LatencyHistogram::LatencyHistogram()
+{
+  for (auto& count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+} /* LatencyHistogram() */
+
+/***********************************************************
+* Add
+* Count 'count' latencies of 'seconds' each.
+***********************************************************/
+void LatencyHistogram::Add(double seconds, uint64_t count)
+{
+  double ns = seconds * 1e9;
+  int bucket = 0;
+  if (ns >= 2.0) {
+    bucket = std::min(static_cast<int>(std::log2(ns)), num_buckets-1);
+  }
+  counts_[bucket].fetch_add(count, std::memory_order_relaxed);
+} /* Add() */
+
+/***********************************************************
+* Percentile
+* Returns an upper bound (in seconds) on the latency below
+* which a fraction 'p' of the latencies fall.
+***********************************************************/
+double LatencyHistogram::Percentile(double p) const
+{
+  uint64_t total = total_count();
+  if (total == 0) return 0.0;
+
+  double target = p * total;
+  uint64_t seen = 0;
+  for (int b = 0; b < num_buckets; b++) {
+    seen += count(b);
+    if (seen >= target) {
+      return std::ldexp(1.0, b+1) * 1e-9;
+    }
+  }
+  return std::ldexp(1.0, num_buckets) * 1e-9;
+} /* Percentile() */
+
+/***********************************************************
+* total_count
+***********************************************************/
+uint64_t LatencyHistogram::total_count() const
+{
+  uint64_t total = 0;
+  for (int b = 0; b < num_buckets; b++) {
+    total += count(b);
+  }
+  return total;
+} /* total_count() */
+
+/***********************************************************
+* Stats constructor
+***********************************************************/
+Stats::Stats() :
+  current_(), last_(), step_start_(), step_start_observations_(0),
+  num_steps_(0), total_seconds_(0.0), total_fn_seconds_(0.0),
+  eval_latency_()
+{
+} /* Stats() */
+
+/***********************************************************
+* BeginStep
+* Start recording a new step.
+***********************************************************/
+void Stats::BeginStep(int num_observations)
+{
+  current_.fn_seconds = 0.0;
+  step_start_observations_ = num_observations;
+  step_start_ = clock::now();
+} /* BeginStep() */
+
+/***********************************************************
+* AddFnTime
+* Record that the objective was being evaluated for
+* 'seconds' of wall time in the current step.
+***********************************************************/
+void Stats::AddFnTime(double seconds)
+{
+  current_.fn_seconds += seconds;
+} /* AddFnTime() */
+
+/***********************************************************
+* EndStep
+* Finish recording the current step. The node space
+* counters in current_step() must be filled in before this
+* is called.
+***********************************************************/
+void Stats::EndStep(int num_observations)
+{
+  current_.step = ++num_steps_;
+  current_.seconds = SecondsSince(step_start_);
+  current_.num_observations = num_observations - step_start_observations_;
+  total_seconds_ += current_.seconds;
+  total_fn_seconds_ += current_.fn_seconds;
+  // Swap rather than copy, so nodes_per_depth keeps its buffer
+  std::swap(current_, last_);
+} /* EndStep() */
+
+/***********************************************************
+* WriteJson
+* Write the counters for the last step, along with the
+* running totals and the latency histogram, as a single
+* line of JSON.
+***********************************************************/
+void Stats::WriteJson(std::ostream& os) const
+{
+  os << "{\"step\": " << last_.step
+     << ", \"observations\": " << last_.num_observations
+     << ", \"seconds\": " << last_.seconds
+     << ", \"fn_seconds\": " << last_.fn_seconds
+     << ", \"bookkeeping_seconds\": " << last_.bookkeeping_seconds()
+     << ", \"live_nodes\": " << last_.live_nodes
+     << ", \"space_bytes\": " << last_.space_bytes
+     << ", \"nodes_per_depth\": [";
+  for (size_t d = 0; d < last_.nodes_per_depth.size(); d++) {
+    os << (d ? ", " : "") << last_.nodes_per_depth[d];
+  }
+  os << "], \"total_seconds\": " << total_seconds_
+     << ", \"total_fn_seconds\": " << total_fn_seconds_
+     << ", \"eval_latency_ns_log2\": [";
+  // Leave off the empty buckets at the end
+  int num_buckets = LatencyHistogram::num_buckets;
+  while (num_buckets > 0 && eval_latency_.count(num_buckets-1) == 0) {
+    num_buckets--;
+  }
+  for (int b = 0; b < num_buckets; b++) {
+    os << (b ? ", " : "") << eval_latency_.count(b);
+  }
+  os << "]}\n";
+} /* WriteJson() */
+
+/***********************************************************
+* SecondsSince
+* Wall time elapsed since 'start', in seconds.
+***********************************************************/
+double Stats::SecondsSince(clock::time_point start)
+{
+  std::chrono::duration<double> elapsed = clock::now() - start;
+  return elapsed.count();
+} /* SecondsSince() */
+
+}
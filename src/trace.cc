@@ -0,0 +1,213 @@
+#include "cpplogo/trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cpplogo {
+
+namespace {
+
+// Layout of the start of a trace file
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dim;
+  uint64_t start_unix_ns; // Wall clock time the trace was opened
+  uint64_t reserved;
+};
+
+const char c_magic[8] = {'C', 'P', 'L', 'G', 'T', 'R', 'C', 'E'};
+const uint32_t c_version = 1;
+
+// How long the writer sleeps when the ring is empty
+const auto c_idle_sleep = std::chrono::microseconds(500);
+
+}
+
+/***********************************************************
+* TraceWriter constructor
+* Create (or truncate) the trace file at 'path' and start
+* the background writer. The ring takes about 'ring_bytes'
+* of memory.
+***********************************************************/
+TraceWriter::TraceWriter(const std::string& path, int dim,
+                         size_t ring_bytes) :
+  dim_(dim), record_bytes_(sizeof(TraceRecord) + dim*sizeof(double)), fd_(-1),
+  ring_(record_bytes_, std::max<size_t>(ring_bytes / record_bytes_, 2)),
+  start_(Stats::clock::now()),
+  num_records_(0), num_waits_(0), stop_(false), failed_(false), writer_()
+{
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("Can't open trace " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  FileHeader header;
+  std::memcpy(header.magic, c_magic, sizeof(c_magic));
+  header.version = c_version;
+  header.dim = dim_;
+  header.start_unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  header.reserved = 0;
+  if (write(fd_, &header, sizeof(header)) != sizeof(header)) {
+    close(fd_);
+    throw std::runtime_error("Can't write trace header to " + path);
+  }
+
+  writer_ = std::thread(&TraceWriter::WriteLoop, this);
+} /* TraceWriter() */
+
+/***********************************************************
+* TraceWriter destructor
+***********************************************************/
+TraceWriter::~TraceWriter()
+{
+  try {
+    Close();
+  } catch (const std::exception&) {
+  }
+} /* ~TraceWriter() */
+
+/***********************************************************
+* Close
+* Write out every record made so far and close the file.
+* Nothing can be recorded afterwards.
+***********************************************************/
+void TraceWriter::Close()
+{
+  if (fd_ < 0) {
+    return;
+  }
+  stop_.store(true, std::memory_order_release);
+  writer_.join();
+  bool closed = close(fd_) == 0;
+  fd_ = -1;
+  if (failed_.load(std::memory_order_acquire) || !closed) {
+    throw std::runtime_error("Failed to write the trace");
+  }
+} /* Close() */
+
+/***********************************************************
+* WaitForSlot
+* Wait for the writer to make room in the ring.
+***********************************************************/
+char* TraceWriter::WaitForSlot()
+{
+  if (fd_ < 0) {
+    throw std::runtime_error("Recorded to a closed trace");
+  }
+  num_waits_++;
+  char* slot;
+  while ((slot = ring_.TryClaim()) == nullptr) {
+    std::this_thread::yield();
+  }
+  return slot;
+} /* WaitForSlot() */
+
+/***********************************************************
+* WriteLoop
+* Body of the background writer: keep draining the ring
+* into the file until Close is called and the ring is
+* empty. If a write fails, the records are still drained
+* (and dropped) so the optimizer never blocks on them.
+***********************************************************/
+void TraceWriter::WriteLoop()
+{
+  while (true) {
+    // Check for stop before looking at the ring, so nothing published
+    // before Close is missed
+    bool stop = stop_.load(std::memory_order_acquire);
+    const char* data;
+    size_t num_slots = ring_.Peek(&data);
+    if (num_slots == 0) {
+      if (stop) {
+        break;
+      }
+      std::this_thread::sleep_for(c_idle_sleep);
+      continue;
+    }
+    if (!failed_.load(std::memory_order_relaxed) &&
+        !WriteSlots(data, num_slots)) {
+      failed_.store(true, std::memory_order_release);
+    }
+    ring_.Release(num_slots);
+  }
+} /* WriteLoop() */
+
+/***********************************************************
+* WriteSlots
+* Write 'num_slots' records straight out of the ring.
+* Returns false on an error.
+***********************************************************/
+bool TraceWriter::WriteSlots(const char* data, size_t num_slots)
+{
+  size_t remaining = num_slots * record_bytes_;
+  while (remaining > 0) {
+    ssize_t written = write(fd_, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    remaining -= written;
+  }
+  return true;
+} /* WriteSlots() */
+
+/***********************************************************
+* TraceReader constructor
+***********************************************************/
+TraceReader::TraceReader(const std::string& path) :
+  dim_(0), record_bytes_(0), num_records_(0), start_unix_ns_(0),
+  map_(nullptr), map_size_(0), data_(nullptr)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Can't open trace " + path + ": " +
+                             std::strerror(errno));
+  }
+  struct stat st;
+  FileHeader header;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(header) ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      std::memcmp(header.magic, c_magic, sizeof(c_magic)) != 0 ||
+      header.version != c_version) {
+    close(fd);
+    throw std::runtime_error("Not a trace file: " + path);
+  }
+
+  dim_ = header.dim;
+  start_unix_ns_ = header.start_unix_ns;
+  record_bytes_ = sizeof(TraceRecord) + dim_*sizeof(double);
+  map_size_ = st.st_size;
+  num_records_ = (map_size_ - sizeof(header)) / record_bytes_;
+  void* map = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Can't map trace " + path + ": " +
+                             std::strerror(errno));
+  }
+  map_ = static_cast<char*>(map);
+  data_ = map_ + sizeof(header);
+} /* TraceReader() */
+
+/***********************************************************
+* TraceReader destructor
+***********************************************************/
+TraceReader::~TraceReader()
+{
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+  }
+} /* ~TraceReader() */
+
+}
@@ -0,0 +1,187 @@
+/***********************************************************
+* bamsoo_test.cc
+* BaMSOO's GP has to work on the objective's own scale, and
+* the search has to stay cheap and finite on objectives the
+* GP describes badly. On objectives it describes well it
+* should need fewer evaluations than SOO.
+***********************************************************/
+#include "check.h"
+
+#include "cpplogo/bamsoo.h"
+#include "cpplogo/soo.h"
+
+#include <cmath>
+#include <random>
+
+using namespace cpplogo;
+
+namespace {
+
+double Sphere(const vectord& x)
+{
+  double sum = 0.0;
+  for (size_t d = 0; d < x.size(); d++) {
+    sum += (x[d]-1.3)*(x[d]-1.3);
+  }
+  return -1000.0*sum;
+}
+
+double Branin(const vectord& x)
+{
+  double b = 5.1 / (4.0*M_PI*M_PI);
+  double c = 5.0 / M_PI;
+  double t = 1.0 / (8.0*M_PI);
+  double y = x[1] - b*x[0]*x[0] + c*x[0] - 6.0;
+  return -1e4 * (y*y + 10.0*(1.0-t)*std::cos(x[0]) + 10.0);
+}
+
+double Rosenbrock(const vectord& x)
+{
+  double sum = 0.0;
+  for (size_t d = 0; d+1 < x.size(); d++) {
+    double a = x[d+1] - x[d]*x[d];
+    sum += 100.0*a*a + (1.0-x[d])*(1.0-x[d]);
+  }
+  return -sum;
+}
+
+void SetMaxPoints(SOO::Options* opt, size_t gp_max_points)
+{
+  (void)opt;
+  (void)gp_max_points;
+}
+
+void SetMaxPoints(BaMSOO::Options* opt, size_t gp_max_points)
+{
+  if (gp_max_points > 0) {
+    opt->gp_max_points = gp_max_points;
+  }
+}
+
+/***********************************************************
+* ObservationsToReach
+* How many observations the optimizer needs to get within
+* 'tolerance' of the objective's maximum.
+***********************************************************/
+template <typename Alg>
+int ObservationsToReach(ObjectiveFn fn, int dim, double lower, double upper,
+                        double max, double tolerance,
+                        size_t gp_max_points = 0)
+{
+  typename Alg::Options opt(fn, dim, 20000, 3);
+  opt.evaluator = std::make_shared<SerialEvaluator>();
+  opt.bounds.assign(dim, Bound(lower, upper));
+  opt.target_value = max - tolerance;
+  SetMaxPoints(&opt, gp_max_points);
+  Alg alg(opt);
+  alg.Optimize();
+  CHECK(alg.best_value() >= opt.target_value);
+  return alg.num_observations();
+}
+
+/***********************************************************
+* TestStandardized
+* Scaling and shifting the observations scales and shifts
+* the GP's predictions the same way.
+***********************************************************/
+void TestStandardized()
+{
+  GaussianProcess gp(2, 0.2, 1.0, 1e-6);
+  GaussianProcess scaled(2, 0.2, 1.0, 1e-6);
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (int i = 0; i < 40; i++) {
+    double point[2] = {uniform(rng), uniform(rng)};
+    double value = std::sin(5.0*point[0]) + point[1];
+    CHECK(gp.Add(point, value) == scaled.Add(point, 1e6*value - 3e4));
+  }
+  for (int i = 0; i < 20; i++) {
+    double point[2] = {uniform(rng), uniform(rng)};
+    double mean, variance, scaled_mean, scaled_variance;
+    gp.Predict(point, &mean, &variance);
+    scaled.Predict(point, &scaled_mean, &scaled_variance);
+    CHECK(std::fabs(scaled_mean - (1e6*mean - 3e4)) < 1e-3);
+    CHECK(std::fabs(scaled_variance - 1e12*variance) <=
+          1e-6*scaled_variance + 1e-9);
+  }
+} /* TestStandardized() */
+
+/***********************************************************
+* TestShrink
+* A full GP keeps its best observation and the most recent
+* ones.
+***********************************************************/
+void TestShrink()
+{
+  GaussianProcess gp(1, 0.1, 1.0, 1e-6);
+  for (int i = 0; i < 20; i++) {
+    double point = i / 20.0;
+    gp.Add(&point, i == 3 ? 100.0 : -i);
+  }
+  gp.Shrink(5);
+  CHECK(gp.size() == 5);
+  double mean, variance;
+  double best = 3 / 20.0;
+  gp.Predict(&best, &mean, &variance);
+  CHECK(std::fabs(mean - 100.0) < 1e-2);
+  double recent = 19 / 20.0;
+  gp.Predict(&recent, &mean, &variance);
+  CHECK(std::fabs(mean + 19.0) < 1e-2);
+  double forgotten = 10 / 20.0;
+  gp.Predict(&forgotten, &mean, &variance);
+  CHECK(variance > 1.0);
+} /* TestShrink() */
+
+/***********************************************************
+* TestSavesEvaluations
+* On objectives far from the unit scale BaMSOO reaches the
+* maximum with fewer evaluations than SOO, and still does
+* with a GP small enough to have been shrunk many times.
+***********************************************************/
+void TestSavesEvaluations()
+{
+  int soo = ObservationsToReach<SOO>(Sphere, 3, -5.0, 10.0, 0.0, 1e-3);
+  int bamsoo = ObservationsToReach<BaMSOO>(Sphere, 3, -5.0, 10.0, 0.0, 1e-3);
+  CHECK(bamsoo < soo);
+  int capped = ObservationsToReach<BaMSOO>(Sphere, 3, -5.0, 10.0, 0.0, 1e-3,
+                                           100);
+  CHECK(capped < soo);
+
+  const double branin_max = -1e4 * 0.397887;
+  soo = ObservationsToReach<SOO>(Branin, 2, -5.0, 15.0, branin_max, 1.0);
+  bamsoo = ObservationsToReach<BaMSOO>(Branin, 2, -5.0, 15.0, branin_max, 1.0);
+  CHECK(bamsoo < soo);
+} /* TestSavesEvaluations() */
+
+/***********************************************************
+* TestBoundedFakes
+* However badly the GP fits, a run uses up its budget of
+* real observations without handing out more than the
+* allowed number of fake values for them.
+***********************************************************/
+void TestBoundedFakes()
+{
+  BaMSOO::Options opt(Rosenbrock, 4, 1000, 3);
+  opt.evaluator = std::make_shared<SerialEvaluator>();
+  opt.bounds.assign(4, Bound(-5.0, 10.0));
+  opt.gp_length_scale = 1.0;
+  opt.max_fakes_per_observation = 2;
+  BaMSOO alg(opt);
+  alg.Optimize();
+  CHECK(alg.num_observations() >= 1000);
+  int num_fakes = alg.observe_policy().num_fake_values();
+  // The GP is wrong often enough to use up most of the allowance
+  CHECK(num_fakes > alg.num_observations());
+  CHECK(num_fakes <= 2*alg.num_observations());
+} /* TestBoundedFakes() */
+
+}
+
+int main()
+{
+  TestStandardized();
+  TestShrink();
+  TestSavesEvaluations();
+  TestBoundedFakes();
+  return 0;
+}
@@ -0,0 +1,17 @@
+/***********************************************************
+* check.h
+* Just enough of a test harness for the tests: CHECK stops
+* the test with a message naming the failed condition.
+***********************************************************/
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,     \
+                   __LINE__, #cond);                                  \
+      std::exit(1);                                                   \
+    }                                                                 \
+  } while (0)
@@ -0,0 +1,203 @@
+/***********************************************************
+* checkpoint_test.cc
+* A run resumed from the file a CheckpointWriter kept up to
+* date has to carry on exactly like the run that was never
+* interrupted, and a checkpoint cut short in the middle of
+* a frame must not be loaded as if it were whole.
+***********************************************************/
+#include "check.h"
+
+#include "cpplogo/checkpoint.h"
+#include "cpplogo/logo.h"
+#include "cpplogo/randomlogo.h"
+#include "cpplogo/soo.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace cpplogo;
+
+namespace {
+
+const int c_dim = 3;
+const int c_max_obs = 3000;
+const int c_num_steps = 150;
+
+// Points the objective was called with, in order
+std::vector<std::vector<double>> observed;
+
+double Objective(const vectord& x)
+{
+  observed.emplace_back(x.begin(), x.end());
+  double sum = 0.0;
+  for (size_t d = 0; d < x.size(); d++) {
+    sum += std::sin(13.0*x[d]) * std::sin(27.0*x[d]) - (x[d]-0.3)*(x[d]-0.3);
+  }
+  return sum;
+}
+
+template <typename Alg>
+typename Alg::Options MakeOptions();
+
+template <>
+SOO::Options MakeOptions<SOO>()
+{
+  SOO::Options opt(Objective, c_dim, c_max_obs, 3);
+  opt.evaluator = std::make_shared<SerialEvaluator>();
+  return opt;
+}
+
+template <>
+LOGO::Options MakeOptions<LOGO>()
+{
+  LOGO::Options opt(Objective, c_dim, c_max_obs, 3, {1, 2, 4, 8});
+  opt.evaluator = std::make_shared<SerialEvaluator>();
+  return opt;
+}
+
+template <>
+RandomLOGO::Options MakeOptions<RandomLOGO>()
+{
+  RandomLOGO::Options opt(Objective, c_dim, c_max_obs, 3, 7, {1, 2, 4, 8});
+  opt.evaluator = std::make_shared<SerialEvaluator>();
+  return opt;
+}
+
+std::string ReadFile(const std::string& path)
+{
+  std::ifstream is(path, std::ios::binary);
+  std::stringstream ss;
+  ss << is.rdbuf();
+  return ss.str();
+}
+
+void WriteFile(const std::string& path, const std::string& data)
+{
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  os << data;
+}
+
+std::string TempPath(const std::string& name)
+{
+  return name + "." + std::to_string(getpid()) + ".ckpt";
+}
+
+/***********************************************************
+* TestResume
+* Run once without stopping, then again with a checkpoint
+* taken after every step, and resume a third optimizer from
+* that checkpoint halfway through. From there on it has to
+* observe the same points as the first run.
+***********************************************************/
+template <typename Alg>
+void TestResume(const std::string& name)
+{
+  observed.clear();
+  {
+    Alg alg(MakeOptions<Alg>());
+    for (int i = 0; i < c_num_steps && !alg.IsFinished(); i++) {
+      alg.Step();
+    }
+  }
+  std::vector<std::vector<double>> uninterrupted = observed;
+
+  std::string path = TempPath(name);
+  observed.clear();
+  int num_observations;
+  double best_value;
+  {
+    Alg alg(MakeOptions<Alg>());
+    CheckpointWriter writer(path);
+    for (int i = 0; i < c_num_steps/2; i++) {
+      alg.Step();
+      writer.Submit(&alg);
+    }
+    writer.Wait();
+    CHECK(writer.num_written() > 0);
+    num_observations = alg.num_observations();
+    best_value = alg.best_value();
+  }
+  CHECK(observed.size() == static_cast<size_t>(num_observations));
+
+  std::ifstream is(path, std::ios::binary);
+  Alg alg(MakeOptions<Alg>(), is);
+  CHECK(alg.num_observations() == num_observations);
+  CHECK(alg.best_value() == best_value);
+  // Loading it must not have evaluated anything
+  CHECK(observed.size() == static_cast<size_t>(num_observations));
+  for (int i = c_num_steps/2; i < c_num_steps && !alg.IsFinished(); i++) {
+    alg.Step();
+  }
+  CHECK(observed == uninterrupted);
+  unlink(path.c_str());
+} /* TestResume() */
+
+/***********************************************************
+* TestTruncated
+* A checkpoint cut off inside its only frame has nothing
+* whole to load and is rejected. One cut off inside a later
+* frame drops the torn frame and loads the one before it.
+***********************************************************/
+void TestTruncated()
+{
+  std::string path = TempPath("truncated");
+  std::string first;
+  std::vector<size_t> sizes;
+  std::vector<int> observations;
+  {
+    SOO alg(MakeOptions<SOO>());
+    CheckpointWriter writer(path);
+    for (int i = 0; i < 20; i++) {
+      alg.Step();
+      writer.Submit(&alg);
+      writer.Wait();
+      std::string data = ReadFile(path);
+      if (i == 0) {
+        first = data;
+      }
+      sizes.push_back(data.size());
+      observations.push_back(alg.num_observations());
+    }
+  }
+  std::string data = ReadFile(path);
+
+  // The only frame starts after the magic and the version
+  size_t frame = 8 + 1;
+  for (size_t size : {frame + 4, first.size()/2, first.size()-1}) {
+    WriteFile(path, first.substr(0, size));
+    std::ifstream is(path, std::ios::binary);
+    bool rejected = false;
+    try {
+      SOO alg(MakeOptions<SOO>(), is);
+    } catch (const std::runtime_error&) {
+      rejected = true;
+    }
+    CHECK(rejected);
+  }
+
+  // Frames appended since the file was last compacted
+  size_t last = sizes.size()-1;
+  CHECK(sizes[last] == data.size());
+  CHECK(sizes[last-1] < sizes[last]);
+  WriteFile(path, data.substr(0, (sizes[last-1] + sizes[last])/2));
+  std::ifstream is(path, std::ios::binary);
+  SOO alg(MakeOptions<SOO>(), is);
+  CHECK(alg.num_observations() == observations[last-1]);
+  unlink(path.c_str());
+} /* TestTruncated() */
+
+}
+
+int main()
+{
+  TestResume<SOO>("soo");
+  TestResume<LOGO>("logo");
+  TestResume<RandomLOGO>("randomlogo");
+  TestTruncated();
+  return 0;
+}
@@ -0,0 +1,260 @@
+/***********************************************************
+* processpool_test.cc
+* ProcessPoolEvaluator has to retry the points whose worker
+* crashed or exited, report the points that keep crashing
+* workers or make the objective throw, and leave nothing
+* behind once it is destroyed: no processes, zombie or not,
+* and no file descriptors.
+***********************************************************/
+#include "check.h"
+
+#include "cpplogo/evaluator.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace cpplogo;
+
+namespace {
+
+const size_t c_num_workers = 3;
+const size_t c_num_points = 12;
+
+// Rows whose first evaluation kills the worker, and how
+const size_t c_abort_row = 2;
+const size_t c_exit_row = 7;
+// Row that kills every worker it is sent to
+const size_t c_always_row = 5;
+// Row the objective throws on
+const size_t c_throw_row = 9;
+
+// Exposes the processes behind the pool
+class TestPool : public ProcessPoolEvaluator {
+  public:
+    using ProcessPoolEvaluator::ProcessPoolEvaluator;
+
+  public:
+    std::vector<pid_t> pids() const
+    {
+      std::vector<pid_t> pids = {server_pid_};
+      for (const auto& worker : workers_) {
+        pids.push_back(worker.pid);
+      }
+      return pids;
+    }
+};
+
+std::string MarkerPath(size_t row, pid_t parent)
+{
+  return "processpool." + std::to_string(parent) + "." + std::to_string(row);
+}
+
+// Is this the first time any worker has seen 'row'? Workers are separate
+// processes, so they find out by racing to create a file.
+bool FirstTime(size_t row, pid_t parent)
+{
+  int fd = open(MarkerPath(row, parent).c_str(),
+                O_CREAT | O_EXCL | O_WRONLY, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+matrixd MakePoints(const std::vector<size_t>& rows)
+{
+  matrixd points(rows.size(), 2);
+  for (size_t i = 0; i < rows.size(); i++) {
+    points(i, 0) = rows[i];
+    points(i, 1) = 0.5;
+  }
+  return points;
+}
+
+double Value(size_t row)
+{
+  return 10.0*row + 0.5;
+}
+
+ObjectiveFn MakeObjective()
+{
+  pid_t parent = getpid();
+  return [parent](const vectord& x) {
+    size_t row = static_cast<size_t>(x[0]);
+    if (row == c_abort_row && FirstTime(row, parent)) {
+      std::abort();
+    }
+    if (row == c_exit_row && FirstTime(row, parent)) {
+      std::exit(3);
+    }
+    if (row == c_always_row) {
+      _exit(4);
+    }
+    if (row == c_throw_row) {
+      throw std::runtime_error("bad point");
+    }
+    if (row >= 100) {
+      // Keeps a worker busy long after the rest of the batch is done
+      std::this_thread::sleep_for(std::chrono::seconds(30));
+    }
+    return Value(row) + x[1];
+  };
+}
+
+size_t CountFds()
+{
+  size_t count = 0;
+  DIR* dir = opendir("/proc/self/fd");
+  CHECK(dir != nullptr);
+  while (readdir(dir) != nullptr) {
+    count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+// Has the process gone completely, i.e. isn't even a zombie?
+bool IsGone(pid_t pid)
+{
+  return kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+/***********************************************************
+* TestRetry
+* Points that crash or exit their worker once get their
+* value from another worker, and each death restarts one.
+***********************************************************/
+void TestRetry()
+{
+  TestPool pool(MakeObjective(), c_num_workers);
+  std::vector<size_t> rows;
+  for (size_t row = 0; row < c_num_points; row++) {
+    if (row != c_always_row && row != c_throw_row) {
+      rows.push_back(row);
+    }
+  }
+  matrixd points = MakePoints(rows);
+  vectord values;
+  pool.Evaluate(ObjectiveFn(), points, &values);
+  CHECK(values.size() == rows.size());
+  for (size_t i = 0; i < rows.size(); i++) {
+    CHECK(values(i) == Value(rows[i]) + 0.5);
+  }
+  CHECK(pool.num_restarts() == 2);
+  CHECK(pool.num_workers() == c_num_workers);
+} /* TestRetry() */
+
+/***********************************************************
+* TestFailures
+* A point that kills every worker it is sent to abandons
+* the batch after 'max_attempts' tries. One the objective
+* throws on still lets the rest of the batch be evaluated
+* before it is reported. The pool is fine afterwards.
+***********************************************************/
+void TestFailures()
+{
+  TestPool pool(MakeObjective(), c_num_workers, 0, 3);
+  vectord values;
+
+  bool crashed = false;
+  try {
+    pool.Evaluate(ObjectiveFn(), MakePoints({0, 1, c_always_row, 3}),
+                  &values);
+  } catch (const std::runtime_error& e) {
+    crashed = std::strstr(e.what(), "every attempt") != nullptr;
+  }
+  CHECK(crashed);
+  CHECK(pool.num_restarts() == 3);
+
+  bool threw = false;
+  try {
+    pool.Evaluate(ObjectiveFn(), MakePoints({0, c_throw_row, 4}), &values);
+  } catch (const std::runtime_error& e) {
+    threw = std::strstr(e.what(), "threw") != nullptr;
+  }
+  CHECK(threw);
+  CHECK(values(0) == Value(0) + 0.5);
+  CHECK(values(2) == Value(4) + 0.5);
+  // Throwing doesn't take the worker down
+  CHECK(pool.num_restarts() == 3);
+
+  pool.Evaluate(ObjectiveFn(), MakePoints({1, 3}), &values);
+  CHECK(values(0) == Value(1) + 0.5);
+  CHECK(values(1) == Value(3) + 0.5);
+} /* TestFailures() */
+
+/***********************************************************
+* TestShutdown
+* Destroying a pool reaps the fork server and every worker,
+* including the ones killed in the middle of a point when a
+* batch was abandoned, and closes all of its sockets.
+***********************************************************/
+void TestShutdown()
+{
+  size_t num_fds = CountFds();
+  std::vector<pid_t> pids;
+  auto start = std::chrono::steady_clock::now();
+  {
+    TestPool pool(MakeObjective(), c_num_workers);
+    pids = pool.pids();
+
+    // The other workers are still busy with the slow points when the
+    // batch is abandoned
+    vectord values;
+    bool crashed = false;
+    try {
+      pool.Evaluate(ObjectiveFn(), MakePoints({100, 101, c_always_row}),
+                    &values);
+    } catch (const std::runtime_error&) {
+      crashed = true;
+    }
+    CHECK(crashed);
+    for (pid_t pid : pool.pids()) {
+      pids.push_back(pid);
+    }
+    for (pid_t pid : pids) {
+      CHECK(pid > 0);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start).count();
+  CHECK(seconds < 10.0);
+
+  for (pid_t pid : pids) {
+    CHECK(IsGone(pid));
+  }
+  // Nothing is left for us to reap
+  CHECK(waitpid(-1, nullptr, WNOHANG) < 0 && errno == ECHILD);
+  CHECK(CountFds() == num_fds);
+} /* TestShutdown() */
+
+}
+
+int main()
+{
+  // Don't leave a core file behind for every deliberate crash
+  struct rlimit no_core = {0, 0};
+  setrlimit(RLIMIT_CORE, &no_core);
+
+  TestRetry();
+  TestFailures();
+  TestShutdown();
+
+  for (size_t row : {c_abort_row, c_exit_row}) {
+    unlink(MarkerPath(row, getpid()).c_str());
+  }
+  return 0;
+}
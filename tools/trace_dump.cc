@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#include "cpplogo/trace.h"
+
+using std::vector;
+using namespace cpplogo;
+
+//Print every record as a line of CSV
+void dump(const TraceReader& trace)
+{
+  std::printf("step,depth,fidelity,seconds,value");
+  for (int d = 0; d < trace.dim(); d++) {
+    std::printf(",x%d", d);
+  }
+  std::printf("\n");
+  for (size_t i = 0; i < trace.size(); i++) {
+    const TraceRecord& record = trace.record(i);
+    std::printf("%llu,%u,%u,%.9f,%.17g",
+                static_cast<unsigned long long>(record.step), record.depth,
+                record.fidelity, record.nanoseconds * 1e-9, record.value);
+    const double* point = trace.point(i);
+    for (int d = 0; d < trace.dim(); d++) {
+      std::printf(",%.17g", point[d]);
+    }
+    std::printf("\n");
+  }
+}
+
+//Print the totals, the best observation and the observations per depth.
+//Low fidelity observations are only counted.
+void summarize(const TraceReader& trace)
+{
+  size_t num_observations = 0;
+  size_t best = trace.size();
+  vector<size_t> per_depth;
+  for (size_t i = 0; i < trace.size(); i++) {
+    const TraceRecord& record = trace.record(i);
+    if (record.fidelity != 0) {
+      continue;
+    }
+    num_observations++;
+    if (best == trace.size() || record.value > trace.record(best).value) {
+      best = i;
+    }
+    if (record.depth >= per_depth.size()) {
+      per_depth.resize(record.depth+1, 0);
+    }
+    per_depth[record.depth]++;
+  }
+
+  std::printf("dim: %d\nobservations: %zu\nlow_fidelity_observations: %zu\n",
+              trace.dim(), num_observations, trace.size() - num_observations);
+  if (num_observations == 0) {
+    return;
+  }
+
+  const TraceRecord& last = trace.record(trace.size()-1);
+  double seconds = last.nanoseconds * 1e-9;
+  std::printf("steps: %llu\nseconds: %.6f\nobservations_per_second: %.1f\n",
+              static_cast<unsigned long long>(last.step+1), seconds,
+              seconds > 0.0 ? num_observations / seconds : 0.0);
+
+  const TraceRecord& record = trace.record(best);
+  std::printf("best_value: %.17g\nbest_observation: %zu\nbest_step: %llu\n"
+              "best_seconds: %.6f\nbest_point:",
+              record.value, best, static_cast<unsigned long long>(record.step),
+              record.nanoseconds * 1e-9);
+  for (int d = 0; d < trace.dim(); d++) {
+    std::printf(" %.17g", trace.point(best)[d]);
+  }
+  std::printf("\nobservations_per_depth:");
+  for (size_t count : per_depth) {
+    std::printf(" %zu", count);
+  }
+  std::printf("\n");
+}
+
+//Usage: cpplogo_trace [--summary] trace_file
+//Prints the observations in a trace written through the 'trace' option as
+//CSV, or with --summary, just the totals and the best observation.
+int main(int argc, char** argv)
+{
+  bool summary = argc > 2 && std::strcmp(argv[1], "--summary") == 0;
+  if (argc != (summary ? 3 : 2)) {
+    std::fprintf(stderr, "Usage: %s [--summary] trace_file\n", argv[0]);
+    return 1;
+  }
+
+  try {
+    TraceReader trace(argv[argc-1]);
+    if (summary) {
+      summarize(trace);
+    } else {
+      dump(trace);
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}